@@ -0,0 +1,139 @@
+from os import environ
+from os.path import abspath, dirname, join
+import random
+import re
+import subprocess
+import tempfile
+import time
+
+# Checks palin_finder.s under qemu-arm over generated inputs, built as the
+# original byte loop, the word at a time scalar code and with the NEON path,
+# and compares their costs. The longest palindrome it prints is checked too.
+#
+# AS, LD and QEMU select the tools. If QEMU_PLUGIN points at qemu's libinsn.so,
+# executed instructions are counted, else only the run time is shown, which
+# qemu's start up dominates for short inputs.
+
+AS = environ.get("AS", "arm-none-eabi-as")
+LD = environ.get("LD", "arm-none-eabi-ld")
+QEMU = environ.get("QEMU", "qemu-arm")
+QEMU_PLUGIN = environ.get("QEMU_PLUGIN")
+
+SOURCE = join(dirname(abspath(__file__)), "palin_finder.s")
+SIZES = [16, 64, 256, 1024, 4096, 16384, 65536]
+VARIANTS = {
+    "byte": ["--defsym", "BYTELOOP=1"],
+    "scalar": ["--defsym", "SCALAR=1"],
+    "neon": [],
+}
+# Longer inputs are not searched for the longest palindrome, see
+# MANACHER_MAX_LEN, and print LONGEST_TOO_LONG instead.
+MANACHER_MAX_LEN = 0x10000
+LONGEST_TOO_LONG = "input too long to search"
+
+
+def is_palindrome(text):
+    chars = [c for c in text.upper() if c != " "]
+    return chars == chars[::-1]
+
+
+def longest_palindrome(text):
+    # Leftmost longest, ignoring spaces and case, as printed from the input.
+    if len(text) > MANACHER_MAX_LEN:
+        return LONGEST_TOO_LONG
+    positions = [i for i, c in enumerate(text) if c != " "]
+    chars = [text[i].upper() for i in positions]
+    best, start = 0, 0
+    for center in range(2 * len(chars) - 1):
+        left, right = center // 2, (center + 1) // 2
+        while left >= 0 and right < len(chars) and chars[left] == chars[right]:
+            left -= 1
+            right += 1
+        if right - left - 1 > best:
+            best, start = right - left - 1, left + 1
+    if best == 0:
+        return ""
+    return text[positions[start] : positions[start + best - 1] + 1]
+
+
+def generate(size, kind, rng):
+    letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    half = "".join(rng.choice(letters) for _ in range(size // 2))
+    text = half + half[::-1].swapcase()
+    if kind == "spaces":
+        # A space every 7 chars, like words. The spaces take the place of
+        # letters, so that the text stays size chars long.
+        spaces = set(rng.sample(range(size), size // 7))
+        chars = size - len(spaces)
+        middle = rng.choice(letters) if chars % 2 else ""
+        half = half[: chars // 2]
+        rest = iter(half + middle + half[::-1].swapcase())
+        text = "".join(" " if i in spaces else next(rest) for i in range(size))
+    elif kind == "mismatch":
+        # Differs in the middle, so all of it is read.
+        text = text[: size // 2 - 1] + "#" + text[size // 2 :]
+    elif kind == "first":
+        # Differs at the first char, so little of it needs to be read.
+        text = "#" + text[1:]
+    return text
+
+
+def build(workdir, variant, text):
+    with open(join(workdir, "palin_input.txt"), "w") as f:
+        f.write(text)
+    obj = join(workdir, variant + ".o")
+    elf = join(workdir, variant + ".elf")
+    subprocess.run(
+        (AS, "-I", workdir, "--defsym", "QEMU=1", *VARIANTS[variant],
+         "-o", obj, SOURCE),
+        check=True,
+    )
+    subprocess.run((LD, "-Ttext=0x10000", "-o", elf, obj), check=True)
+    return elf
+
+
+def run(elf):
+    cmd = [QEMU]
+    if QEMU_PLUGIN:
+        cmd += ["-plugin", QEMU_PLUGIN, "-d", "plugin"]
+    start = time.perf_counter()
+    proc = subprocess.run((*cmd, elf), capture_output=True)
+    elapsed = time.perf_counter() - start
+    insns = None
+    match = re.search(rb"insns: (\d+)", proc.stderr)
+    if match:
+        insns = int(match.group(1))
+    longest = re.search(rb"Longest palindrome: ([^\n]*)", proc.stdout)
+    longest = longest.group(1).decode() if longest else None
+    return proc.returncode == 0, longest, insns, elapsed
+
+
+def main():
+    rng = random.Random(1)
+    unit = "insns" if QEMU_PLUGIN else "ms"
+    print(f"{'size':>6} {'kind':<9}"
+          + "".join(f" {variant + ' ' + unit:>14}" for variant in VARIANTS))
+    failures = 0
+    with tempfile.TemporaryDirectory() as workdir:
+        for size in SIZES:
+            for kind in ("plain", "spaces", "mismatch", "first"):
+                text = generate(size, kind, rng)
+                want = is_palindrome(text)
+                want_longest = longest_palindrome(text)
+                costs = []
+                for variant in VARIANTS:
+                    got, longest, insns, elapsed = run(build(workdir, variant, text))
+                    if got != want:
+                        failures += 1
+                        print(f"{variant} says {got} for {size} {kind}, want {want}")
+                    if longest != want_longest:
+                        failures += 1
+                        print(f"{variant} finds the wrong longest palindrome for {size} {kind}")
+                    costs.append(insns if insns is not None else elapsed * 1000)
+                print(f"{size:>6} {kind:<9}"
+                      + "".join(f" {cost:>14.0f}" for cost in costs))
+    print("OK" if failures == 0 else f"{failures} FAILED")
+
+
+if __name__ == "__main__":
+    main()
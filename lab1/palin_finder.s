@@ -1,15 +1,83 @@
 .global _start
 
+// Build with --defsym QEMU=1 to run under qemu-arm: the LEDs and the JTAG UART
+// become plain memory, UART output is copied to stdout, the input is included
+// from palin_input.txt, and _exit exits with status 0 for a palindrome, 1
+// otherwise. --defsym SCALAR=1 leaves out the NEON path. --defsym BYTELOOP=1
+// uses the original byte at a time strlen and is_palindrome instead of the
+// word at a time ones, to measure them against; it implies SCALAR.
+
+.ifdef BYTELOOP
+.set SCALAR, 1 // The byte loop has no NEON path
+.endif
+.arch armv7-a // Needed for rbit, rev, clz and isb
+.ifndef SCALAR
+.fpu neon // Allow the NEON instructions
+.endif
+
 _start:
+.ifndef QEMU
+.ifndef SCALAR
+	// Enable NEON, which is off after reset
+	mrc p15, 0, r0, c1, c0, 2 // Read CPACR
+	orr r0, #0xF00000 // Allow full access to cp10 and cp11
+	mcr p15, 0, r0, c1, c0, 2 // Write CPACR
+	isb // Wait for the change to take effect
+	mov r0, #0x40000000 // Set FPEXC.EN
+	vmsr fpexc, r0 // Enable the VFP/NEON unit
+.endif
+.endif
 	// Load input and call is_palindrome
 	ldr r0, =input // Set r0 to pointer to input string.
 	bl is_palindrome // Check if is palindrome.
-	teq r0, #0 // Is false?
+	mov r4, r0 // Keep the result, as the calls change the flags
+	teq r4, #0 // Is false?
 	bleq palindrome_not_ok // Yes => Notify IS NOT a palindrome.
+	teq r4, #0 // Is true?
 	blne palindrome_ok // No => Notify IS a palindrome.
 	
+	// Write the longest palindrome within input to UART
+	ldr r0, =longestPalindrome // Set r0 to pointer to the heading
+	bl print // Call print
+	ldr r0, =input // Set r0 to pointer to input string.
+	bl longest_palindrome // Find the longest palindrome
+	teq r0, #0 // Was the input too long to search?
+	ldreq r0, =longestTooLong // Yes => print a notice instead.
+	ldreq r1, =longestTooLongEnd
+	bl print_range // Print it
+	bl uart_flush // Wait until all output is sent
+	
 	b _exit	// Jump to exit
 
+// Loads the possibly unaligned word at address addr into dst, using aligned
+// loads, as unaligned loads fault with the MMU off. Only the aligned words
+// overlapping [addr, addr+4) are read: one if addr is aligned, else two.
+// Clobbers t0, t1 and the flags.
+.macro load_word dst, addr, t0, t1
+	bic \t0, \addr, #3 // Aligned address of the first word
+	ands \t1, \addr, #3 // Byte offset into the first word. Aligned?
+	ldr \dst, [\t0] // Load the first word
+	ldrne \t0, [\t0, #4] // No => load the second word
+	lslne \t1, #3 // Offset in bits
+	lsrne \dst, \t1 // Drop the bytes before addr
+	rsbne \t1, \t1, #32 // Bits taken from the second word
+	orrne \dst, \t0, lsl \t1 // Append them
+.endm
+
+// Makes the characters of the word w uppercase, all four at once and without
+// branches. Expects r6=0x01010101, r8=0x1F1F1F1F and r9=0x05050505.
+// Clobbers t0 and t1.
+.macro to_upper_word w, t0, t1
+	bic \t0, \w, r6, lsl #7 // Clear the top bit of every byte (x)
+	add \t1, \t0, r8 // Top bit set where x >= 'a'
+	add \t0, \t0, r9 // Top bit set where x > 'z'
+	bic \t1, \t0 // Top bit set where 'a' <= x <= 'z'
+	bic \t1, \w // Only for chars below 0x80
+	and \t1, r6, lsl #7 // Keep just the top bits
+	eor \w, \t1, lsr #2 // Clear bit 5 of the lowercase chars
+.endm
+
+.ifdef BYTELOOP
 // Returns the string length (in r0) of the text pointed to by r0.
 strlen:
 	eor r1, r1 // Clear r1
@@ -17,26 +85,26 @@ strlen_loop:
 	ldrb r2, [r0] // Load char from string into r2
 	teq r2, #0 // Have we reached NUL?
 	beq strlen_ret // If so, return.
-	
+
 	add r1, #1 // Increment length
 	add r0, #1 // Increment string pointer
 	b strlen_loop // Loop again
 strlen_ret:
 	mov r0, r1 // Move string length to r0
 	mov pc, lr // Return to caller
-	
+
 // Makes the character in r0 lowercase.
 to_upper:
 	cmp r0, #0x61 // Compare char to 'a'
 	blt to_upper_ret // Return if char <= 'a'.
 	// Return if r0 >= 'z'
-	cmp r0, #0x7A // Compare char to 'z' 
+	cmp r0, #0x7A // Compare char to 'z'
 	bgt to_upper_ret // Return if char >= 'z'
-	
+
 	sub r0, #0x20 // Make the character uppercase.
 to_upper_ret:
 	mov pc, lr // Return to caller
-	
+
 // Compares the characters in register r0 and r1 case insensitively.
 // r0 = 0 if chars were equal, else, r0 != 0.
 cmpchar_nocase:
@@ -53,8 +121,8 @@ cmpchar_nocase:
 	sub r0, r1
 	// Return
 	pop {pc} // Return to caller
-	
-	
+
+
 // Checks if the string in r0 is a palindrome.
 // Returns r0=1 if true, else, r0!=0.
 is_palindrome:
@@ -82,7 +150,7 @@ read_end:
 	ldrb r1, [r5] // Read end character
 	teq r1, #0x20 // Is character space?
 	beq read_end // Jump back and read another end chacter if it was a space
-	
+
 	// Compare start and end
 	bl cmpchar_nocase // Compare the start and end character
 	teq r0, #0 // Compare return value to 0
@@ -95,24 +163,487 @@ is_palindrome_false:
 	mov r0, #0 // Set return value to 0.
 is_palindrome_ret:
 	pop {r4, r5, pc} // Restore registers
+.else
+// Returns the string length (in r0) of the text pointed to by r0.
+// Reads a word at a time once r0 is aligned. A word holds a NUL if
+// (w - 0x01010101) & ~w & 0x80808080 is nonzero, and its lowest set bit marks
+// the first NUL.
+strlen:
+	mov r1, r0 // Keep the start of the string
+	ldr r3, =0x01010101 // Set r3 to 0x01 in every byte
+strlen_align:
+	tst r0, #3 // Is the pointer aligned?
+	beq strlen_words // Yes => read whole words.
+	ldrb r2, [r0] // Load char from string into r2
+	teq r2, #0 // Have we reached NUL?
+	beq strlen_ret // If so, return.
+	add r0, #1 // Increment string pointer
+	b strlen_align // Loop again
+strlen_words:
+	ldr r2, [r0], #4 // Load a word and increment string pointer
+	sub r12, r2, r3 // Subtract 1 from every byte
+	bic r12, r2 // Keep the bytes which were below 0x80
+	ands r12, r3, lsl #7 // Keep the top bits. Any set?
+	beq strlen_words // No NUL => loop again.
+	sub r0, #4 // Point back at the word
+	rbit r12, r12 // Reverse the bits, the first NUL is now on top
+	clz r12, r12 // Count bits before the first NUL
+	add r0, r12, lsr #3 // Point at the NUL
+strlen_ret:
+	sub r0, r1 // Length is the NUL pointer minus the start
+	mov pc, lr // Return to caller
+
+// Checks if the string in r0 is a palindrome, ignoring case and spaces.
+// Returns r0=1 if true, else, r0=0.
+// Compares 4 chars from each end at a time while neither holds a space, and
+// a char from each end at a time otherwise.
+// Strings of NEON_MIN_LEN chars or more go to is_palindrome_neon instead.
+is_palindrome:
+	push {r4-r9, lr} // Save registers
+	mov r4, r0 // Move string pointer into r4
+	// Determine string length
+	bl strlen // Get length of string
+	// Set up pointers: r4=start, r5=end, one past the chars left to compare
+.ifndef SCALAR
+	// Long strings go through NEON, if they fit in palin_buffer
+	cmp r0, #NEON_MIN_LEN // Is the string long?
+	blo is_palindrome_words // No => 4 chars at a time.
+	cmp r0, #PALIN_BUFFER_SIZE // Does it fit?
+	bhi is_palindrome_words // No => 4 chars at a time.
+	mov r1, r0 // Move string length to r1
+	mov r0, r4 // Move string pointer to r0
+	bl is_palindrome_neon // Check with NEON
+	b is_palindrome_ret // Return its result
+is_palindrome_words:
+.endif
+	add r5, r4, r0 // Set end pointer to string pointer + strlen
+	ldr r6, =0x01010101 // Constants for the word operations
+	ldr r7, =0x20202020
+	ldr r8, =0x1F1F1F1F
+	ldr r9, =0x05050505
+is_palindrome_loop:
+	sub r0, r5, r4 // chars left = end - start
+	cmp r0, #4 // Are there 4 chars left?
+	blt is_palindrome_char // No => compare a char at a time.
+	// Read 4 chars from the start into r0 and the 4 before end into r1
+	load_word r0, r4, r2, r3
+	sub r12, r5, #4 // Point at the last 4 chars
+	load_word r1, r12, r2, r3
+	// Check for spaces, as zero bytes of the words xor 0x20202020
+	eor r2, r0, r7 // Space chars of r0 become 0
+	sub r3, r2, r6 // Zero byte check of r2
+	bic r2, r3, r2
+	eor r3, r1, r7 // Space chars of r1 become 0
+	sub r12, r3, r6 // Zero byte check of r3
+	bic r3, r12, r3
+	orr r2, r3 // Merge both checks
+	tst r2, r6, lsl #7 // Any spaces?
+	bne is_palindrome_char // Yes => skip them a char at a time.
+	// Compare start and end, the end reversed
+	to_upper_word r0, r2, r3
+	to_upper_word r1, r2, r3
+	rev r1, r1 // Reverse the end chars
+	cmp r0, r1 // Compare the 4 chars
+	bne is_palindrome_false // Return false if inequal
+	add r4, #4 // Offset start by 4
+	sub r5, #4 // Offset end by -4
+	b is_palindrome_loop // Perform another loop iteration.
+is_palindrome_char:
+	// Skip spaces at the start
+	cmp r4, r5 // Any chars left?
+	bhs is_palindrome_true // No => palindrome. return true!
+	ldrb r0, [r4] // Read start character
+	teq r0, #0x20 // Is character space?
+	addeq r4, #1 // Offset start by 1 if it was a space
+	beq is_palindrome_char // and read another start character.
+is_palindrome_char_end:
+	// Skip spaces at the end. Stops at start at the latest, which is no space.
+	ldrb r1, [r5, #-1] // Read end character
+	teq r1, #0x20 // Is character space?
+	subeq r5, #1 // Offset end by -1 if it was a space
+	beq is_palindrome_char_end // and read another end character.
+	// Make both uppercase, without branches
+	sub r2, r0, #0x61 // Offset from 'a'
+	cmp r2, #26 // Is char within 'a'..'z'?
+	sublo r0, #0x20 // Yes => make uppercase.
+	sub r2, r1, #0x61 // Same for the end character
+	cmp r2, #26
+	sublo r1, #0x20
+	cmp r0, r1 // Compare start and end character
+	bne is_palindrome_false // Return false if inequal
+	add r4, #1 // Offset start by 1
+	sub r5, #1 // Offset end by -1
+	b is_palindrome_loop // Back to 4 chars at a time.
+is_palindrome_true:
+	mov r0, #1 // Set return value to 1.
+	b is_palindrome_ret // Jump to return
+is_palindrome_false:
+	mov r0, #0 // Set return value to 0.
+is_palindrome_ret:
+	pop {r4-r9, pc} // Restore registers
+.endif
+
+.ifndef SCALAR
+// Appends the 16 chars of q0 to the buffer at out, made uppercase and without
+// spaces, and moves out past them. Expects the constants and tables set up by
+// is_palindrome_neon. Clobbers r0-r2 and q1-q3.
+.macro neon_compact out
+	// Make them uppercase
+	vsub.i8 q1, q0, q9 // Offset from 'a'
+	vcgt.u8 q1, q10, q1 // All ones where within 'a'..'z'
+	vand q1, q8 // 0x20 where within 'a'..'z'
+	vsub.i8 q0, q1 // Make those uppercase
+	// Get a mask of the spaces, one byte for each half of q0
+	vceq.i8 q1, q0, q8 // All ones where space
+	vand q1, q11 // Only the bit of the lane
+	vpadd.i8 d2, d2, d3 // Sum up the bits of each half
+	vpadd.i8 d2, d2, d2
+	vpadd.i8 d2, d2, d2
+	vmov.u16 r0, d2[0] // Move the masks to r0
+	uxtb r1, r0 // Set r1 to the mask of the first half
+	lsr r0, #8 // Set r0 to the mask of the second half
+	// Compact each half, the kept chars moved to its start
+	add r2, r7, r1, lsl #3 // Point at the indices of the first half
+	vld1.8 {d4}, [r2] // Read the indices
+	add r2, r7, r0, lsl #3 // Point at the indices of the second half
+	vld1.8 {d5}, [r2] // Read the indices
+	vtbl.8 d6, {d0}, d4 // Compact the first half
+	vtbl.8 d7, {d1}, d5 // Compact the second half
+	// Append the kept chars of both halves
+	vst1.8 {d6}, [\out] // Write the first half
+	ldrb r2, [r12, r1] // Read how many chars were kept
+	add \out, r2 // Move past them
+	vst1.8 {d7}, [\out] // Write the second half
+	ldrb r2, [r12, r0] // Read how many chars were kept
+	add \out, r2 // Move past them
+.endm
+
+// Checks if the string in r0 of length r1 is a palindrome using NEON, ignoring
+// case and spaces. The length must be at most PALIN_BUFFER_SIZE.
+// Returns r0=1 if true, else, r0=0.
+// The chars are made uppercase and compacted out of spaces 16 at a time,
+// from the start into palin_buffer (F) and from the end, backwards, into
+// palin_buffer_back (B), always adding to the shorter one. The string without
+// spaces is then F followed by B reversed, so it is a palindrome if F and B
+// agree where both have chars, and the longer one mirrors itself after that.
+// The chars both have are compared 16 at a time as they come in, so a
+// mismatch near either end returns early.
+is_palindrome_neon:
+	push {r4-r11, lr} // Save registers
+	mov r4, r0 // Set r4 to the next char to compact from the start
+	add r6, r0, r1 // Set r6 to one past the next char from the end
+	ldr r10, =palin_buffer // Set r10 to F
+	ldr r11, =palin_buffer_back // Set r11 to B
+	mov r5, r10 // Set r5 to the end of F
+	mov r8, r11 // Set r8 to the end of B
+	mov r9, #0 // Set r9 to the number of chars compared
+	ldr r7, =palin_compact // Set r7 to the compaction indices
+	ldr r12, =palin_compact_len // Set r12 to the compacted lengths
+	ldr r0, =palin_lane_bits
+	vld1.8 {d22, d23}, [r0] // Set q11 to the bit of every lane
+	vmov.i8 q8, #0x20 // Set q8 to spaces
+	vmov.i8 q9, #0x61 // Set q9 to 'a'
+	vmov.i8 q10, #26 // Set q10 to the number of letters
+is_palindrome_neon_block:
+	sub r0, r6, r4 // chars left = end - next
+	cmp r0, #16 // Are there 16 chars left?
+	blt is_palindrome_neon_middle // No => one at a time.
+	sub r0, r5, r10 // Length of F
+	sub r1, r8, r11 // Length of B
+	cmp r0, r1 // Is F the longer one?
+	bhi is_palindrome_neon_back // Yes => add to B.
+	vld1.8 {d0, d1}, [r4]! // Read 16 chars from the start into q0
+	neon_compact r5 // Append them to F
+	b is_palindrome_neon_compare // Compare what is new
+is_palindrome_neon_back:
+	sub r6, #16 // Offset end by -16
+	vld1.8 {d0, d1}, [r6] // Read 16 chars before the end into q0
+	vrev64.8 q0, q0 // Reverse each half
+	vswp d0, d1 // and swap the halves, so the last char comes first
+	neon_compact r8 // Append them to B
+is_palindrome_neon_compare:
+	// Compare 16 chars of F and B at a time, while both have them
+	sub r0, r5, r10 // Length of F
+	sub r1, r8, r11 // Length of B
+	cmp r0, r1 // Set r0 to the shorter length
+	movhi r0, r1
+	sub r0, #16 // Last index 16 chars can be compared from
+	cmp r9, r0 // Are there 16 chars to compare?
+	bgt is_palindrome_neon_block // No => compact more.
+	add r1, r10, r9 // Point at the next chars of F
+	vld1.8 {d0, d1}, [r1] // Read them
+	add r1, r11, r9 // Point at the next chars of B
+	vld1.8 {d2, d3}, [r1] // Read them
+	veor q0, q1 // Zero where they match
+	vorr d0, d1 // Merge both halves
+	vmov r0, r1, d0 // Move the differences to r0 and r1
+	orrs r0, r1 // Any differences?
+	bne is_palindrome_neon_false // Yes => not a palindrome.
+	add r9, #16 // 16 more chars compared
+	b is_palindrome_neon_compare // Loop again
+is_palindrome_neon_middle:
+	// Append the chars left between start and end to F, one at a time
+	cmp r4, r6 // Any chars left?
+	bhs is_palindrome_neon_rest // No => compare the rest.
+	ldrb r0, [r4], #1 // Read a char
+	teq r0, #0x20 // Is character space?
+	beq is_palindrome_neon_middle // Yes => skip it.
+	sub r1, r0, #0x61 // Offset from 'a'
+	cmp r1, #26 // Is char within 'a'..'z'?
+	sublo r0, #0x20 // Yes => make uppercase.
+	strb r0, [r5], #1 // Append the char
+	b is_palindrome_neon_middle // Loop again
+is_palindrome_neon_rest:
+	// Compare the rest of the chars both F and B have, one at a time
+	sub r0, r5, r10 // Length of F
+	sub r1, r8, r11 // Length of B
+	add r2, r0, r1 // Set r2 to the length of the string without spaces
+	cmp r0, r1 // Which one is longer?
+	movhi r0, r1 // Set r0 to the shorter length
+	movhi r3, r10 // Set r3 to the longer one
+	movls r3, r11
+is_palindrome_neon_rest_both:
+	cmp r9, r0 // Any chars both have left?
+	bhs is_palindrome_neon_rest_mirror // No => compare the longer one.
+	ldrb r1, [r10, r9] // Read a char of F
+	ldrb r12, [r11, r9] // and of B
+	cmp r1, r12 // Compare them
+	bne is_palindrome_neon_false // Return false if inequal
+	add r9, #1 // Next char
+	b is_palindrome_neon_rest_both // Loop again
+is_palindrome_neon_rest_mirror:
+	// The chars past the shorter length lie in the longer buffer, in the
+	// middle of the string, and must mirror each other
+	add r0, r3, r9 // Set r0 to the first char
+	sub r1, r2, r9 // Set r1 to one past the last char
+	add r1, r3
+is_palindrome_neon_rest_mirror_loop:
+	sub r2, r1, #1 // Point at the last char
+	cmp r0, r2 // Are two chars left?
+	bhs is_palindrome_neon_true // No => palindrome.
+	ldrb r2, [r0], #1 // Read start character
+	ldrb r3, [r1, #-1]! // Read end character
+	cmp r2, r3 // Compare start and end character
+	bne is_palindrome_neon_false // Return false if inequal
+	b is_palindrome_neon_rest_mirror_loop // Loop again
+is_palindrome_neon_true:
+	mov r0, #1 // Set return value to 1.
+	pop {r4-r11, pc} // Restore registers
+is_palindrome_neon_false:
+	mov r0, #0 // Set return value to 0.
+	pop {r4-r11, pc} // Restore registers
+.endif
+
+// Finds the longest palindrome within the string in r0, ignoring case and
+// spaces like is_palindrome, using Manacher's algorithm.
+// Returns its start in r0 and its end (exclusive) in r1, both pointing into
+// the string; r0=r1 if the string has no chars, and r0=r1=0 if it has more
+// than MANACHER_MAX_LEN.
+// The string without spaces, s, is made uppercase in manacher_chars, with the
+// address of every char in manacher_pos. Palindromes of even length get a
+// center by looking at s with a separator before, between and after all
+// chars: t = |s0|s1|...|s(n-1)|, of length m = 2n+1. t[i] is s[i/2] for odd
+// i, and a separator for even i. manacher_radii[i] is the radius of the
+// longest palindrome of t centered on i, which is also its length in s.
+longest_palindrome:
+	push {r4-r11, lr} // Save registers
+	mov r4, r0 // Move string pointer into r4
+	bl strlen // Get length of string
+	ldr r1, =MANACHER_MAX_LEN
+	cmp r0, r1 // Is it too long?
+	bhi longest_palindrome_too_long // Yes => no result.
+	// Make s: r4=next char, r3=end of string, r2=length of s
+	add r3, r4, r0 // Set end pointer to string pointer + strlen
+	ldr r5, =manacher_chars // Set r5 to s
+	ldr r6, =manacher_pos // Set r6 to the addresses of s
+	mov r2, #0 // s is empty
+longest_palindrome_compact:
+	cmp r4, r3 // Any chars left?
+	bhs longest_palindrome_search // No => search.
+	ldrb r0, [r4] // Read a char
+	teq r0, #0x20 // Is character space?
+	beq longest_palindrome_compact_next // Yes => skip it.
+	sub r1, r0, #0x61 // Offset from 'a'
+	cmp r1, #26 // Is char within 'a'..'z'?
+	sublo r0, #0x20 // Yes => make uppercase.
+	strb r0, [r5, r2] // Append the char to s
+	str r4, [r6, r2, lsl #2] // and its address
+	add r2, #1 // Increment length of s
+longest_palindrome_compact_next:
+	add r4, #1 // Increment string pointer
+	b longest_palindrome_compact // Loop again
+longest_palindrome_search:
+	teq r2, #0 // Is s empty?
+	moveq r0, r4 // Yes => empty result, at the end of the string.
+	moveq r1, r4
+	popeq {r4-r11, pc} // Restore registers
+	// r4=s, r5=radii, r6=m, r7=i, r8=center and r9=right end of the
+	// palindrome reaching furthest right, r10=longest radius, r11=its center
+	ldr r4, =manacher_chars
+	ldr r5, =manacher_radii
+	lsl r6, r2, #1 // m = 2n+1
+	add r6, #1
+	mov r7, #0 // i = 0
+	mov r8, #0 // center = 0
+	mov r9, #0 // right = 0
+	mov r10, #0 // longest radius = 0
+	mov r11, #0 // its center = 0
+longest_palindrome_center:
+	// Start from the radius of the mirror of i around center, as far as it
+	// lies within the palindrome at center.
+	mov r0, #0 // radius = 0
+	cmp r7, r9 // Is i within the palindrome at center?
+	bge longest_palindrome_expand // No => start from 0.
+	rsb r1, r7, r8, lsl #1 // mirror = 2 * center - i
+	ldr r1, [r5, r1, lsl #2] // Read radius of mirror
+	sub r2, r9, r7 // Room left = right - i
+	cmp r1, r2 // radius = min(radius of mirror, room left)
+	movlo r0, r1
+	movhs r0, r2
+longest_palindrome_expand:
+	add r1, r7, r0 // Right neighbour = i + radius + 1
+	add r1, #1
+	cmp r1, r6 // Past the end of t?
+	bhs longest_palindrome_expanded // Yes => done.
+	sub r2, r7, r0 // Left neighbour = i - radius - 1
+	subs r2, #1 // Before the start of t?
+	bmi longest_palindrome_expanded // Yes => done.
+	tst r2, #1 // Are both neighbours separators?
+	beq longest_palindrome_grow // Yes => they match.
+	ldrb r3, [r4, r2, lsr #1] // Read left neighbour from s
+	ldrb r12, [r4, r1, lsr #1] // Read right neighbour from s
+	cmp r3, r12 // Do they match?
+	bne longest_palindrome_expanded // No => done.
+longest_palindrome_grow:
+	add r0, #1 // Increment radius
+	b longest_palindrome_expand // Try to grow again
+longest_palindrome_expanded:
+	str r0, [r5, r7, lsl #2] // Store radius of i
+	add r1, r7, r0 // Right end = i + radius
+	cmp r1, r9 // Does it reach further right?
+	movgt r8, r7 // Yes => it becomes the palindrome at center.
+	movgt r9, r1
+	cmp r0, r10 // Is it the longest?
+	movgt r10, r0 // Yes => remember it.
+	movgt r11, r7
+	add r7, #1 // Increment i
+	cmp r7, r6 // Any centers left?
+	blt longest_palindrome_center // Yes => loop again.
+	// Map the longest back to the string: it starts at s[(center-radius)/2]
+	ldr r2, =manacher_pos
+	sub r3, r11, r10 // Index of start in s
+	lsr r3, #1
+	ldr r0, [r2, r3, lsl #2] // Read address of start
+	add r3, r10 // Index of last char in s
+	sub r3, #1
+	ldr r1, [r2, r3, lsl #2] // Read address of last char
+	add r1, #1 // End is one past it
+	pop {r4-r11, pc} // Restore registers
+longest_palindrome_too_long:
+	mov r0, #0 // No result
+	mov r1, #0
+	pop {r4-r11, pc} // Restore registers
+
+// UART output goes through a ring buffer of UART_RING_SIZE chars. uart_head
+// and uart_tail count the chars put into and sent from it; their difference
+// is the number of chars waiting. Chars are sent in bursts of as many as the
+// JTAG UART FIFO has space for, read from the WSPACE field of its control
+// register, so no char is dropped on a full FIFO.
+
+// Sends as many waiting chars as the JTAG UART FIFO has space for, without
+// waiting.
+uart_drain:
+	ldr r12, =uart_head // Set r12 to the ring buffer state
+	ldr r0, [r12] // Read head
+	ldr r1, [r12, #4] // Read tail
+	ldr r2, =JTAG // Set r2 to the JTAG base address.
+	ldr r3, [r2, #4] // Read the control register
+	lsr r3, #16 // Set r3 to WSPACE, the free space in the FIFO
+	sub r0, r1 // Set r0 to the number of waiting chars
+	cmp r3, r0 // Send min(WSPACE, waiting) chars
+	movhi r3, r0
+	add r3, r1 // Set r3 to the tail after the burst
+uart_drain_loop:
+	cmp r1, r3 // Any chars left in the burst?
+	bhs uart_drain_ret // No => done.
+	and r0, r1, #UART_RING_SIZE - 1 // Index into the ring buffer
+	add r0, r12
+	ldrb r0, [r0, #8] // Read char from uart_ring
+	strb r0, [r2] // Write character into JTAG UART address.
+.ifdef QEMU
+	// Copy the char to stdout
+	push {r0-r3, r7} // Save registers
+	mov r1, r2 // Write the char just stored
+	mov r0, #1 // to stdout
+	mov r2, #1 // 1 char
+	mov r7, #4 // write system call
+	svc #0
+	pop {r0-r3, r7} // Restore registers
+.endif
+	add r1, #1 // Increment tail
+	b uart_drain_loop // Loop again
+uart_drain_ret:
+	str r1, [r12, #4] // Store tail
+	mov pc, lr // Return to caller
+
+// Waits until all chars in the ring buffer are sent.
+uart_flush:
+	push {lr} // Save lr, as we perform calls inside this function.
+uart_flush_loop:
+	bl uart_drain // Send what fits
+	ldr r0, =uart_head // Set r0 to the ring buffer state
+	ldr r1, [r0] // Read head
+	ldr r0, [r0, #4] // Read tail
+	cmp r0, r1 // Any chars waiting?
+	bne uart_flush_loop // Yes => loop again.
+	pop {pc} // Return to caller
+
+// Prints the chars from r0 up to r1 (exclusive) into the JTAG UART port,
+// through the ring buffer. Chars which do not fit into the FIFO yet stay
+// in the ring buffer until the next print or uart_flush.
+print_range:
+	push {r4-r6, lr} // Save registers
+	mov r4, r0 // Set r4 to the next char
+	mov r5, r1 // Set r5 to the end
+	ldr r6, =uart_head // Set r6 to the ring buffer state
+print_range_loop:
+	cmp r4, r5 // Any chars left?
+	bhs print_range_ret // No => return.
+	ldr r1, [r6] // Read head
+	ldr r2, [r6, #4] // Read tail
+	sub r3, r1, r2 // Number of waiting chars
+	cmp r3, #UART_RING_SIZE // Is the ring buffer full?
+	blo print_range_put // No => put the char.
+	bl uart_drain // Make room
+	b print_range_loop // Try again
+print_range_put:
+	ldrb r0, [r4], #1 // Read char and increment pointer
+	and r3, r1, #UART_RING_SIZE - 1 // Index into the ring buffer
+	add r3, r6
+	strb r0, [r3, #8] // Write char into uart_ring
+	add r1, #1 // Increment head
+	str r1, [r6] // Store head
+	b print_range_loop // Loop again
+print_range_ret:
+	bl uart_drain // Send what fits right away
+	pop {r4-r6, pc} // Restore registers
 
 // Prints the string pointed to by r0 into the JTAG UART port.
 print:
-	ldr r2, =#JTAG // Set r2 to the JTAG base address.
-	ldrb r1, [r0] // Read character
-	teq r1, #0 // Compare character to NUL.
-	moveq pc, lr // Return if character was NUL.
-	// Write char to UART
-	strb r1, [r2] // Write character into JTAG UART address.
-	add r0, #1 // Increment string pointer by one.
-	b print // Loop again.
+	push {r4, lr} // Save registers
+	mov r4, r0 // Move string pointer into r4
+	bl strlen // Get length of string
+	add r1, r4, r0 // Set end pointer to string pointer + strlen
+	mov r0, r4 // Set start pointer
+	bl print_range // Print the chars
+	pop {r4, pc} // Restore registers
 	
 // Notifies that the palindrome was OK.
 palindrome_ok:
 	push {lr} // Store lr, as we perform function calls
 	
 	// Switch on only the 5 leftmost LEDs
-	ldr r0, =#LEDR // Store LEDR base address into r0
+	ldr r0, =LEDR // Store LEDR base address into r0
 	mov r1, #0b1111100000 // Set the 5 leftmost LED bits
 	str r1, [r0] // Write LED bits into LED peripheral register
 	
@@ -127,7 +658,7 @@ palindrome_not_ok:
 	push {lr}
 	
 	// Switch on only the 5 rightmost LEDs
-	ldr r0, =#LEDR // Store LEDR base address into r0
+	ldr r0, =LEDR // Store LEDR base address into r0
 	mov r1, #0b11111 // Set the 5 rightmost LED bits
 	str r1, [r0]// Write LED bits into LED peripheral register
 	
@@ -139,18 +670,109 @@ palindrome_not_ok:
 	
 _exit:
 	// Branch here for exit
+.ifdef QEMU
+	// Exit with status 0 if the LEDs show a palindrome, else 1
+	ldr r0, =LEDR // Store LEDR base address into r0
+	ldr r0, [r0] // Read the LED bits
+	teq r0, #0b1111100000 // Are the 5 leftmost LEDs on?
+	moveq r0, #0 // Yes => status 0.
+	movne r0, #1 // No => status 1.
+	mov r7, #1 // exit system call
+	svc #0 // Exit
+.endif
 	b .
 
+.ifdef QEMU
+.equ LEDR, qemu_ledr // LEDR stand-in.
+.equ JTAG, qemu_jtag // JTAG stand-in.
+.else
 .equ LEDR, 0xFF200000 // LEDR base address.
 .equ JTAG, 0xFF201000 // JTAG base address.
+.endif
+
+// Size of the UART ring buffer, a power of two of at most 256.
+.equ UART_RING_SIZE, 256
+// Longest string longest_palindrome searches, 64 KiB. Its working arrays take
+// 13 bytes per char of .bss; longer inputs print a notice instead.
+.equ MANACHER_MAX_LEN, 0x10000
+
+// Strings shorter than this are checked without NEON.
+.equ NEON_MIN_LEN, 64
+// Size of palin_buffer, the longest string checked with NEON.
+.equ PALIN_BUFFER_SIZE, 0x10000
 
 .data
 .align
 	// This is the input you are supposed to check for a palindrom
 	// You can modify the string during development, however you
 	// are not allowed to change the name 'input'!
+.ifdef QEMU
+	input: .incbin "palin_input.txt"
+	.byte 0
+.else
 	input: .asciz "levelx"
+.endif
 	
 	palindrome: .asciz "Palindrome detected"
 	notPalindrome: .asciz "Not a palindrome"
+	longestPalindrome: .asciz "\nLongest palindrome: "
+	longestTooLong: .ascii "input too long to search"
+	longestTooLongEnd:
+
+.align
+	// UART ring buffer: chars put into it, chars sent, and the chars.
+	uart_head: .word 0
+	uart_tail: .word 0
+	uart_ring: .space UART_RING_SIZE
+.ifdef QEMU
+	// JTAG stand-in: data register, and control register with WSPACE set.
+	qemu_jtag: .word 0, 0xFFFF0000
+.endif
+
+.ifndef SCALAR
+	// Bit of each lane, to turn a vector compare into a mask.
+	palin_lane_bits: .byte 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+
+	// For every mask of spaces in 8 chars, the indices of the other chars in
+	// order, padded with 0xFF (read as 0 by vtbl).
+	palin_compact:
+	.set mask, 0
+	.rept 256
+		.irp lane, 0, 1, 2, 3, 4, 5, 6, 7
+			.if !(mask & (1 << \lane))
+				.byte \lane
+			.endif
+		.endr
+		.irp lane, 0, 1, 2, 3, 4, 5, 6, 7
+			.if mask & (1 << \lane)
+				.byte 0xFF
+			.endif
+		.endr
+		.set mask, mask + 1
+	.endr
+
+	// For every mask of spaces in 8 chars, the number of other chars.
+	palin_compact_len:
+	.set mask, 0
+	.rept 256
+		.byte 8 - ((mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1) + ((mask >> 4) & 1) + ((mask >> 5) & 1) + ((mask >> 6) & 1) + ((mask >> 7) & 1))
+		.set mask, mask + 1
+	.endr
+.endif
+
+.bss
+.align
+.ifndef SCALAR
+	// The uppercased input without spaces, from the start and backwards from
+	// the end, plus room for the last 8 byte store past their ends.
+	palin_buffer: .space PALIN_BUFFER_SIZE + 8
+	palin_buffer_back: .space PALIN_BUFFER_SIZE + 8
+.endif
+.ifdef QEMU
+	qemu_ledr: .space 4
+.endif
+	// Arena of the working arrays of longest_palindrome.
+	manacher_pos: .space MANACHER_MAX_LEN * 4
+	manacher_radii: .space (MANACHER_MAX_LEN * 2 + 1) * 4
+	manacher_chars: .space MANACHER_MAX_LEN
 .end
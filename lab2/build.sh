@@ -1,3 +1,9 @@
 #!/bin/sh
 
-gcc cache_sim.c -o cache_sim
+# libcachesim, as a static library for cache_sim and a shared library for
+# other tools.
+gcc -O2 -c -fPIC libcachesim.c -o libcachesim.o
+ar rcs libcachesim.a libcachesim.o
+gcc -shared libcachesim.o -o libcachesim.so
+
+gcc cache_sim.c libcachesim.a -o cache_sim
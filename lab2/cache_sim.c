@@ -6,81 +6,20 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define LINE_SIZE 64
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-typedef enum { dm, fa } cache_map_t;
-typedef enum { uc, sc } cache_org_t;
-typedef enum { instruction, data } access_t;
+#include "libcachesim.h"
 
-typedef struct {
-	uint32_t address;
-	access_t type;
-} mem_access_t;
-
-typedef struct {
-	uint64_t accesses;
-	uint64_t hits;
-	// You can declare additional statistics if
-	// you like, however you are now allowed to
-	// remove the accesses or hits
-} cache_stat_t;
-
-// DECLARE CACHES AND COUNTERS FOR THE STATS HERE
-
-// cacheline_t represents a cache line within a cache.
-typedef struct {
-	union {
-		// Struct for use with DM (direct mapping).
-		struct {
-			bool dm_valid : 1;
-			uint32_t dm_tag : 31;
-		};
-		// Struct for use with FA (fully associative)
-		struct {
-			bool fa_valid : 1;
-			uint32_t fa_tag : 31;
-			uint32_t fa_place_time;
-		};
-	};
-} cacheline_t;
+#define MAX_CORES 64
+// Number of trace accesses handed to the cache at once.
+#define TRACE_BATCH 1024
 
-// cache_t represents a cache.
-typedef struct {
-	cache_map_t map;
-	cache_org_t org;
-	cache_stat_t stats;
-	// The total lines in cache (sum of all lines, even in split cache).
-	uint32_t lines_len;
-	// Array of cache lines. Split in two at midway point when using
-	// split cache.
-	cacheline_t *lines;
-	// Union for mapping type specific values.
-	union {
-		// DM (direct mapping) values.
-		struct {
-			// How much to shift the address to the right in order for the
-			// tag to be at the least significant bit.
-			uint32_t dm_tag_shift;
-			// Bitmask for the index bits of the address.
-			uint32_t dm_index_mask;
-			// How many bits to shift the address to the right in order for
-			// the index to be at the least significant bit.
-			uint32_t dm_index_shift;
-			// Bitmask for the offset bits of the address.
-			uint32_t dm_offset_mask;
-		};
-		// FA (fully associative) values.
-		struct {
-			// How much to shift the address to the right in order for the
-			// tag to be at the least significant bit.
-			uint32_t fa_tag_shift;
-			// Bitmask for the offset bits of the address.
-			uint32_t fa_offset_mask;
-			// Cache time which increases by 1 for every access.
-			uint32_t fa_time;
-		};
-	};
-} cache_t;
+typedef enum { round_robin, timestamp } coh_interleave_t;
 
 // cmdargs_t is a convenience struct for reading in the command line arguments.
 typedef struct {
@@ -88,144 +27,23 @@ typedef struct {
 	cache_map_t mapping;
 	cache_org_t organization;
 	char *file;
+	// Per-core trace files for the coherence simulation, 0 cores if off.
+	char *core_files[MAX_CORES];
+	uint32_t cores;
+	coh_protocol_t protocol;
+	coh_interleave_t interleave;
+	// Source of a binary record stream, NULL if off.
+	char *stream;
+	// Accesses per interval of the streaming statistics.
+	uint64_t interval;
+	// Whether to run the timing model, and its configuration.
+	bool timing;
+	timing_config_t timing_config;
+	// Whether to look up a TLB before the cache, and its configuration.
+	bool tlb;
+	tlb_config_t tlb_config;
 } cmdargs_t;
 
-// cache_new creates a new cache with the specified mapping, organization and
-// size.
-cache_t cache_new(cache_map_t map, cache_org_t org, uint32_t size) {
-	uint32_t lines_len = size / LINE_SIZE;
-	// Initialize cache struct.
-	cache_t cache = {
-		.map = map,
-		.org = org,
-		.stats = { 0 },
-		.lines_len = lines_len,
-		.lines = calloc(lines_len, sizeof(cacheline_t)),
-	};
-	// Organized lines are halved in split cache. One for instructions, and one
-	// for data.
-	uint32_t org_lines_len =
-		cache.org == uc ? cache.lines_len : (cache.lines_len / 2);
-	switch (cache.map) {
-	case dm:
-		// Set up the cache as a DM cache.
-		// subtract one gives us mask for powers of two.
-		cache.dm_offset_mask = LINE_SIZE - 1;
-		cache.dm_index_shift = __builtin_popcount(cache.dm_offset_mask);
-		cache.dm_index_mask = (org_lines_len - 1) << cache.dm_index_shift;
-		cache.dm_tag_shift =
-			cache.dm_index_shift + __builtin_popcount(cache.dm_index_mask);
-		break;
-	case fa:
-		// Set up the cache as a FA cache.
-		// subtract one gives us mask for powers of two.
-		cache.fa_time = 0;
-		cache.fa_offset_mask = LINE_SIZE - 1;
-		cache.fa_tag_shift = __builtin_popcount(cache.fa_offset_mask);
-		break;
-	}
-
-	return cache;
-}
-
-// cache_access_dm performs a DM cache access on the provided lines.
-void cache_access_dm(cache_t *cache, mem_access_t access, cacheline_t *lines,
-					 uint32_t lines_len) {
-	uint32_t tag = access.address >> cache->dm_tag_shift;
-	uint32_t index =
-		(access.address & cache->dm_index_mask) >> cache->dm_index_shift;
-	uint32_t offset = access.address & cache->dm_offset_mask;
-
-	// Check for hit, or evict & replace.
-	cacheline_t *line = &lines[index];
-	if (line->dm_valid && line->dm_tag == tag) {
-		// Cache hit!
-		cache->stats.hits++;
-	} else {
-		// Cache miss!
-		line->dm_valid = true;
-		line->dm_tag = tag;
-	}
-}
-
-// cache_access_fa performs a FA cache access on the provided lines.
-// It uses a FIFO eviction policy.
-void cache_access_fa(cache_t *cache, mem_access_t access, cacheline_t *lines,
-					 uint32_t lines_len) {
-	uint32_t tag = access.address >> cache->fa_tag_shift;
-	uint32_t offset = access.address & cache->fa_offset_mask;
-
-	// Search for a valid cache line with the correct tag.
-	bool found = false;
-	for (uintptr_t i = 0; i < lines_len; i++) {
-		if (lines[i].fa_valid && lines[i].fa_tag == tag) {
-			found = true;
-		}
-	}
-
-	if (found) {
-		// Cache hit!
-		cache->stats.hits++;
-	} else {
-		// Cache miss!
-		// Evist oldest line or the first invalid line (FIFO).
-		// Replace that line with the provided line.
-		cacheline_t *evict = &lines[0];
-		for (int i = 0; i < lines_len; i++) {
-			if (!lines[i].fa_valid) {
-				evict = &lines[i];
-				break;
-			}
-			if (lines[i].fa_place_time < evict->fa_place_time) {
-				evict = &lines[i];
-			}
-		}
-
-		// Update the line.
-		evict->fa_valid = true;
-		evict->fa_place_time = cache->fa_time;
-		evict->fa_tag = tag;
-	}
-
-	cache->fa_time++;
-}
-
-// cache_access performs a cache access.
-void cache_access(cache_t *cache, mem_access_t access) {
-	uint32_t lines_beg;
-	uint32_t lines_len;
-
-	// Determine lines which are accessible.
-	// * UC - Full access to all lines
-	// * SC - Half of lines to instructions, other half for data.
-	switch (cache->org) {
-	case uc:
-		lines_beg = 0;
-		lines_len = cache->lines_len;
-		break;
-	case sc:
-		lines_len = cache->lines_len >> 1;
-		lines_beg = access.type == instruction ? lines_len : 0;
-		break;
-	}
-
-	cacheline_t *lines = &cache->lines[lines_beg];
-
-	// Run the respective cache access function.
-	switch (cache->map) {
-	case fa:
-		cache_access_fa(cache, access, lines, lines_len);
-		break;
-	case dm:
-		cache_access_dm(cache, access, lines, lines_len);
-		break;
-	}
-
-	cache->stats.accesses++;
-}
-
-void cache_free(cache_t *cache) { free(cache->lines); }
-
 /* Reads a memory access from the trace file and returns
  * 1) access type (instruction or data access
  * 2) memory address
@@ -235,11 +53,12 @@ mem_access_t read_transaction(FILE *ptr_file) {
 	mem_access_t access;
 
 	if (fscanf(ptr_file, "%c %x\n", &type, &access.address) == 2) {
-		if (type != 'I' && type != 'D') {
+		if (type != 'I' && type != 'D' && type != 'R' && type != 'W') {
 			printf("Unkown access type\n");
 			exit(0);
 		}
-		access.type = (type == 'I') ? instruction : data;
+		access.type = (type == 'I') ? access_instruction : access_data;
+		access.write = type == 'W';
 		return access;
 	}
 
@@ -251,11 +70,39 @@ mem_access_t read_transaction(FILE *ptr_file) {
 }
 
 cmdargs_t parse_args(int argc, char **argv) {
-	cmdargs_t args;
-	if (argc < 4 || argc > 5) { /* argc should be 2 for correct execution */
+	cmdargs_t args = {
+		.protocol = coh_mesi,
+		.interleave = round_robin,
+		.interval = 1000000,
+		.timing_config = {
+			.hit_latency = 1,
+			.row_hit_latency = 20,
+			.row_miss_latency = 60,
+			.mem_banks = 8,
+			.row_size = 2048,
+			.mshrs = 4,
+		},
+		.tlb_config = {
+			.entries = 64,
+			.ways = 4,
+			.org = cache_sc,
+			.page_size = 4096,
+			.walk_latency = 20,
+		},
+	};
+	if (argc < 4) { /* argc should be 2 for correct execution */
 		printf("Usage: ./cache_sim [cache size: 128-4096] [cache mapping: "
 			   "dm|fa] [file]"
-			   "[cache organization: uc|sc]\n");
+			   "[cache organization: uc|sc]\n"
+			   "       [--cores trace0,trace1,...] [--protocol msi|mesi]"
+			   " [--interleave rr|ts]\n"
+			   "       [--stream -|fifo|unix:path] [--interval accesses]\n"
+			   "       [--timing] [--hit-lat cycles] [--row-hit cycles]"
+			   " [--row-miss cycles]\n"
+			   "       [--mem-banks banks] [--row-size bytes] [--mshrs misses]\n"
+			   "       [--tlb entries] [--tlb-ways ways] [--tlb-org uc|sc]"
+			   " [--page-size 4k|2m|4m]\n"
+			   "       [--walk-levels levels] [--walk-lat cycles]\n");
 		exit(0);
 	}
 	/* argv[0] is program name, parameters start with argv[1] */
@@ -265,9 +112,9 @@ cmdargs_t parse_args(int argc, char **argv) {
 
 	/* Set Cache Mapping */
 	if (strcmp(argv[2], "dm") == 0) {
-		args.mapping = dm;
+		args.mapping = cache_dm;
 	} else if (strcmp(argv[2], "fa") == 0) {
-		args.mapping = fa;
+		args.mapping = cache_fa;
 	} else {
 		printf("Unknown cache mapping\n");
 		exit(0);
@@ -275,23 +122,493 @@ cmdargs_t parse_args(int argc, char **argv) {
 
 	/* Set Cache Organization */
 	if (strcmp(argv[3], "uc") == 0) {
-		args.organization = uc;
+		args.organization = cache_uc;
 	} else if (strcmp(argv[3], "sc") == 0) {
-		args.organization = sc;
+		args.organization = cache_sc;
 	} else {
 		printf("Unknown cache organization\n");
 		exit(0);
 	}
 
-	if (argc >= 5) {
-		args.file = argv[4];
-	} else {
-		args.file = "mem_trace.txt";
+	args.file = "mem_trace.txt";
+	for (int i = 4; i < argc; i++) {
+		if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+			/* Comma separated trace files, one per core */
+			for (char *file = strtok(argv[++i], ","); file;
+				 file = strtok(NULL, ",")) {
+				if (args.cores == MAX_CORES) {
+					printf("At most %d cores are supported\n", MAX_CORES);
+					exit(0);
+				}
+				args.core_files[args.cores++] = file;
+			}
+		} else if (strcmp(argv[i], "--protocol") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "msi") == 0) {
+				args.protocol = coh_msi;
+			} else if (strcmp(argv[i], "mesi") == 0) {
+				args.protocol = coh_mesi;
+			} else {
+				printf("Unknown coherence protocol\n");
+				exit(0);
+			}
+		} else if (strcmp(argv[i], "--interleave") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "rr") == 0) {
+				args.interleave = round_robin;
+			} else if (strcmp(argv[i], "ts") == 0) {
+				args.interleave = timestamp;
+			} else {
+				printf("Unknown interleaving\n");
+				exit(0);
+			}
+		} else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			args.stream = argv[++i];
+		} else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+			args.interval = strtoull(argv[++i], NULL, 10);
+			if (args.interval == 0) {
+				printf("The interval must be at least one access\n");
+				exit(0);
+			}
+		} else if (strcmp(argv[i], "--timing") == 0) {
+			args.timing = true;
+		} else if (strcmp(argv[i], "--hit-lat") == 0 && i + 1 < argc) {
+			args.timing = true;
+			args.timing_config.hit_latency = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--row-hit") == 0 && i + 1 < argc) {
+			args.timing = true;
+			args.timing_config.row_hit_latency = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--row-miss") == 0 && i + 1 < argc) {
+			args.timing = true;
+			args.timing_config.row_miss_latency = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--mem-banks") == 0 && i + 1 < argc) {
+			args.timing = true;
+			args.timing_config.mem_banks = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--row-size") == 0 && i + 1 < argc) {
+			args.timing = true;
+			args.timing_config.row_size = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--mshrs") == 0 && i + 1 < argc) {
+			args.timing = true;
+			args.timing_config.mshrs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--tlb") == 0 && i + 1 < argc) {
+			args.tlb = true;
+			args.tlb_config.entries = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--tlb-ways") == 0 && i + 1 < argc) {
+			args.tlb = true;
+			args.tlb_config.ways = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--tlb-org") == 0 && i + 1 < argc) {
+			args.tlb = true;
+			i++;
+			if (strcmp(argv[i], "uc") == 0) {
+				args.tlb_config.org = cache_uc;
+			} else if (strcmp(argv[i], "sc") == 0) {
+				args.tlb_config.org = cache_sc;
+			} else {
+				printf("Unknown TLB organization\n");
+				exit(0);
+			}
+		} else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+			args.tlb = true;
+			/* Bytes, with an optional k or m suffix */
+			char *unit;
+			args.tlb_config.page_size = strtoul(argv[++i], &unit, 10);
+			if (*unit == 'k' || *unit == 'K') {
+				args.tlb_config.page_size <<= 10;
+			} else if (*unit == 'm' || *unit == 'M') {
+				args.tlb_config.page_size <<= 20;
+			}
+		} else if (strcmp(argv[i], "--walk-levels") == 0 && i + 1 < argc) {
+			args.tlb = true;
+			args.tlb_config.walk_levels = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--walk-lat") == 0 && i + 1 < argc) {
+			args.tlb = true;
+			args.tlb_config.walk_latency = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+			args.file = argv[++i];
+		} else if (argv[i][0] != '-') {
+			args.file = argv[i];
+		} else {
+			printf("Unknown option %s\n", argv[i]);
+			exit(0);
+		}
+	}
+	// The coherence and stream modes have their own loops, which leave out
+	// the timing model and the TLB.
+	if (args.cores > 0 && args.stream) {
+		printf("--cores and --stream cannot be combined\n");
+		exit(0);
+	}
+	if ((args.cores > 0 || args.stream) && (args.timing || args.tlb)) {
+		printf("--timing and --tlb cannot be combined with %s\n",
+			   args.cores > 0 ? "--cores" : "--stream");
+		exit(0);
 	}
 
 	return args;
 }
 
+// Coherence simulation
+// Runs the cores of libcachesim over one trace per core.
+
+// core_trace_t holds the trace of a core.
+typedef struct {
+	FILE *trace;
+	// The next access of the trace, and its timestamp.
+	mem_access_t next;
+	uint64_t next_time;
+	bool done;
+} core_trace_t;
+
+// read_core_transaction reads the next access of a core trace. Lines are
+// "[timestamp] type address", where the timestamp is only needed when
+// interleaving by timestamp. Returns false at the end of the trace.
+bool read_core_transaction(core_trace_t *core) {
+	char line[128];
+	char type;
+	while (fgets(line, sizeof(line), core->trace)) {
+		if (sscanf(line, "%" SCNu64 " %c %x", &core->next_time, &type,
+				   &core->next.address) != 3) {
+			core->next_time = 0;
+			if (sscanf(line, " %c %x", &type, &core->next.address) != 2) {
+				// Skip blank lines.
+				continue;
+			}
+		}
+		switch (type) {
+		case 'I':
+			core->next.type = access_instruction;
+			core->next.write = false;
+			break;
+		case 'D':
+		case 'R':
+			core->next.type = access_data;
+			core->next.write = false;
+			break;
+		case 'W':
+			core->next.type = access_data;
+			core->next.write = true;
+			break;
+		default:
+			printf("Unkown access type\n");
+			exit(0);
+		}
+		return true;
+	}
+	core->done = true;
+	return false;
+}
+
+// run_coherence runs the coherence simulation over the per-core traces and
+// prints the statistics.
+int run_coherence(cmdargs_t args) {
+	coh_core_t cores[MAX_CORES];
+	core_trace_t traces[MAX_CORES] = { 0 };
+	for (uint32_t i = 0; i < args.cores; i++) {
+		cores[i] =
+			coh_core_new(args.mapping, args.organization, args.cache_size);
+		if (!cores[i].cache) {
+			printf("Unable to allocate the cache\n");
+			return 1;
+		}
+		traces[i].trace = fopen(args.core_files[i], "r");
+		if (!traces[i].trace) {
+			printf("Unable to open the trace file %s\n", args.core_files[i]);
+			return 1;
+		}
+		read_core_transaction(&traces[i]);
+	}
+
+	uint32_t self = args.cores - 1;
+	while (1) {
+		// Pick the core of the next access.
+		bool found = false;
+		if (args.interleave == timestamp) {
+			// The earliest access, ties go to the lowest core.
+			for (uint32_t i = 0; i < args.cores; i++) {
+				if (!traces[i].done &&
+					(!found || traces[i].next_time < traces[self].next_time)) {
+					self = i;
+					found = true;
+				}
+			}
+		} else {
+			// The next core after the last one, which still has accesses.
+			for (uint32_t i = 1; i <= args.cores && !found; i++) {
+				uint32_t c = (self + i) % args.cores;
+				if (!traces[c].done) {
+					self = c;
+					found = true;
+				}
+			}
+		}
+		if (!found) {
+			break;
+		}
+		coh_access(cores, args.cores, self, args.protocol, traces[self].next);
+		read_core_transaction(&traces[self]);
+	}
+
+	printf("\nCoherence Statistics (%s, %u cores)\n",
+		   args.protocol == coh_msi ? "MSI" : "MESI", args.cores);
+	printf("-----------------\n");
+	cache_stat_t total = { 0 };
+	coh_stat_t coh_total = { 0 };
+	for (uint32_t i = 0; i <= args.cores; i++) {
+		cache_stat_t stats;
+		coh_stat_t coh;
+		if (i < args.cores) {
+			stats = cache_stats(cores[i].cache);
+			coh = cores[i].stats;
+			printf("\nCore %u (%s)\n", i, args.core_files[i]);
+			total.accesses += stats.accesses;
+			total.hits += stats.hits;
+			coh_total.bus_reads += coh.bus_reads;
+			coh_total.bus_read_exclusives += coh.bus_read_exclusives;
+			coh_total.bus_upgrades += coh.bus_upgrades;
+			coh_total.invalidations += coh.invalidations;
+			coh_total.false_sharing += coh.false_sharing;
+			coh_total.c2c_transfers += coh.c2c_transfers;
+			coh_total.writebacks += coh.writebacks;
+		} else {
+			stats = total;
+			coh = coh_total;
+			printf("\nTotal\n");
+		}
+		printf("Accesses:       %" PRIu64 "\n", stats.accesses);
+		printf("Hits:           %" PRIu64 "\n", stats.hits);
+		printf("Hit Rate:       %.4f\n",
+			   stats.accesses ? (double)stats.hits / stats.accesses : 0.0);
+		printf("Bus Reads:      %" PRIu64 "\n", coh.bus_reads);
+		printf("Bus ReadX:      %" PRIu64 "\n", coh.bus_read_exclusives);
+		printf("Bus Upgrades:   %" PRIu64 "\n", coh.bus_upgrades);
+		printf("Invalidations:  %" PRIu64 "\n", coh.invalidations);
+		printf("False Sharing:  %" PRIu64 "\n", coh.false_sharing);
+		printf("C2C Transfers:  %" PRIu64 "\n", coh.c2c_transfers);
+		printf("Writebacks:     %" PRIu64 "\n", coh.writebacks);
+	}
+	printf("-----------------\n");
+
+	for (uint32_t i = 0; i < args.cores; i++) {
+		fclose(traces[i].trace);
+		coh_core_free(&cores[i]);
+	}
+	return 0;
+}
+
+// Streaming simulation
+// Reads binary records from stdin, a FIFO, a file or a Unix domain socket
+// until the writer closes it, with a fixed size buffer, and prints the
+// statistics of every interval of accesses as it goes.
+
+// Number of records read at once.
+#define STREAM_BATCH 4096
+
+// open_stream opens the stream source. "-" is stdin, "unix:path" listens on
+// a Unix domain socket at path and accepts one tracer, anything else is
+// opened as a file or FIFO. Returns -1 on failure.
+int open_stream(const char *source) {
+	if (strcmp(source, "-") == 0) {
+		return STDIN_FILENO;
+	}
+	if (strncmp(source, "unix:", 5) != 0) {
+		int fd = open(source, O_RDONLY);
+		if (fd < 0) {
+			perror("unable to open the trace stream");
+		}
+		return fd;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *path = source + 5;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		perror("unable to create socket");
+		return -1;
+	}
+	// Replace a socket left behind by an earlier run, but nothing else.
+	struct stat st;
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "%s exists and is not a socket\n", path);
+			close(sock);
+			return -1;
+		}
+		unlink(path);
+	}
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(sock, 1) < 0) {
+		perror("unable to listen on socket");
+		close(sock);
+		return -1;
+	}
+	fprintf(stderr, "Waiting for a tracer on %s\n", path);
+	int fd = accept(sock, NULL, NULL);
+	if (fd < 0) {
+		perror("unable to accept tracer");
+	}
+	close(sock);
+	unlink(path);
+	return fd;
+}
+
+// print_interval prints the statistics of an interval, and of all accesses up
+// to it.
+void print_interval(uint64_t interval, cache_stat_t now, cache_stat_t last) {
+	uint64_t accesses = now.accesses - last.accesses;
+	uint64_t hits = now.hits - last.hits;
+	printf("Interval %" PRIu64 ": Accesses: %" PRIu64 " Hits: %" PRIu64
+		   " Hit Rate: %.4f Total Hit Rate: %.4f\n",
+		   interval, accesses, hits,
+		   accesses ? (double)hits / accesses : 0.0,
+		   now.accesses ? (double)now.hits / now.accesses : 0.0);
+	fflush(stdout);
+}
+
+// run_stream runs the simulation over a stream of binary records and prints
+// the statistics.
+int run_stream(cmdargs_t args) {
+	int fd = open_stream(args.stream);
+	if (fd < 0) {
+		return 1;
+	}
+
+	cache_t *cache =
+		cache_new(args.mapping, args.organization, args.cache_size);
+	if (!cache) {
+		printf("Unable to allocate the cache\n");
+		return 1;
+	}
+	mem_record_t records[STREAM_BATCH];
+	mem_access_t accesses[STREAM_BATCH];
+	// Bytes of a record cut off by the previous read.
+	size_t partial = 0;
+	cache_stat_t last = { 0 };
+	uint64_t interval = 0;
+
+	while (1) {
+		ssize_t n = read(fd, (char *)records + partial,
+						 sizeof(records) - partial);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			perror("unable to read the trace stream");
+			break;
+		}
+		if (n == 0) {
+			break;
+		}
+		size_t bytes = partial + n;
+		size_t records_len = bytes / sizeof(mem_record_t);
+		for (size_t i = 0; i < records_len; i++) {
+			char type = records[i].type;
+			if (type != 'I' && type != 'D' && type != 'R' && type != 'W') {
+				printf("Unkown access type\n");
+				exit(0);
+			}
+			accesses[i].address = records[i].address;
+			accesses[i].type = (type == 'I') ? access_instruction : access_data;
+			accesses[i].write = type == 'W';
+		}
+
+		// Hand the accesses over in pieces ending at interval boundaries.
+		for (size_t beg = 0; beg < records_len;) {
+			cache_stat_t stats = cache_stats(cache);
+			uint64_t until = args.interval - (stats.accesses - last.accesses);
+			size_t len = records_len - beg < until ? records_len - beg : until;
+			cache_access_batch(cache, &accesses[beg], len);
+			beg += len;
+			stats = cache_stats(cache);
+			if (stats.accesses - last.accesses == args.interval) {
+				print_interval(++interval, stats, last);
+				last = stats;
+			}
+		}
+
+		// Keep the cut off record for the next read.
+		partial = bytes % sizeof(mem_record_t);
+		memmove(records, (char *)records + bytes - partial, partial);
+	}
+	cache_stat_t stats = cache_stats(cache);
+	if (stats.accesses != last.accesses) {
+		print_interval(++interval, stats, last);
+	}
+	if (partial) {
+		fprintf(stderr, "Ignoring %zu trailing bytes of the trace stream\n",
+				partial);
+	}
+	if (fd != STDIN_FILENO) {
+		close(fd);
+	}
+
+	printf("\nCache Statistics\n");
+	printf("-----------------\n\n");
+	printf("Accesses: %" PRIu64 "\n", stats.accesses);
+	printf("Hits:		%" PRIu64 "\n", stats.hits);
+	printf("Hit Rate: %.4f\n",
+		   stats.accesses ? (double)stats.hits / stats.accesses : 0.0);
+	cache_free(cache);
+	return 0;
+}
+
+// print_timing prints the statistics of the timing model.
+void print_timing(timing_t *timing, uint64_t accesses) {
+	timing_stat_t *stats = &timing->stats;
+	printf("\nTiming Statistics\n");
+	printf("-----------------\n\n");
+	printf("AMAT:         %.4f cycles\n",
+		   accesses ? (double)stats->total_latency / accesses : 0.0);
+	printf("Cycles:       %" PRIu64 "\n", stats->cycles);
+	printf("Stall Cycles: %" PRIu64 "\n", stats->stall_cycles);
+	printf("MSHR Merges:  %" PRIu64 "\n", stats->mshr_merges);
+	printf("Row Hits:     %" PRIu64 "\n", stats->row_hits);
+	printf("Row Misses:   %" PRIu64 "\n", stats->row_misses);
+	printf("\nLatency Histogram\n");
+	for (uint32_t i = 0; i < TIMING_HIST_LEN; i++) {
+		if (stats->hist[i] == 0) {
+			continue;
+		}
+		if (i == TIMING_HIST_LEN - 1) {
+			printf("  %5u+      : %" PRIu64 "\n", 1u << i, stats->hist[i]);
+		} else {
+			printf("  %5u-%-5u : %" PRIu64 "\n", 1u << i, (2u << i) - 1,
+				   stats->hist[i]);
+		}
+	}
+}
+
+// print_tlb prints the statistics of the TLB.
+void print_tlb(tlb_t *tlb) {
+	tlb_stat_t *stats = &tlb->stats;
+	uint64_t accesses = stats->accesses[access_instruction] + stats->accesses[access_data];
+	uint64_t hits = stats->hits[access_instruction] + stats->hits[access_data];
+	printf("\nTLB Statistics\n");
+	printf("-----------------\n\n");
+	printf("Page Size:    %" PRIu32 " bytes, %" PRIu32 " walk levels\n",
+		   tlb->config.page_size, tlb->config.walk_levels);
+	printf("Accesses:     %" PRIu64 "\n", accesses);
+	printf("Hits:         %" PRIu64 "\n", hits);
+	printf("Hit Rate:     %.4f\n", accesses ? (double)hits / accesses : 0.0);
+	if (tlb->config.org == cache_sc) {
+		printf("I Hit Rate:   %.4f\n",
+			   stats->accesses[access_instruction]
+				   ? (double)stats->hits[access_instruction] /
+						 stats->accesses[access_instruction]
+				   : 0.0);
+		printf("D Hit Rate:   %.4f\n",
+			   stats->accesses[access_data]
+				   ? (double)stats->hits[access_data] / stats->accesses[access_data]
+				   : 0.0);
+	}
+	printf("Walks:        %" PRIu64 "\n", stats->walks);
+	printf("Walk Cycles:  %" PRIu64 "\n", stats->walk_cycles);
+}
+
 int main(int argc, char **argv) {
 
 	/* Read command-line parameters and initialize:
@@ -306,7 +623,29 @@ int main(int argc, char **argv) {
 
 	cmdargs_t args = parse_args(argc, argv);
 
-	cache_t cache = cache_new(args.mapping, args.organization, args.cache_size);
+	if (args.cores > 0) {
+		return run_coherence(args);
+	}
+	if (args.stream) {
+		return run_stream(args);
+	}
+
+	cache_t *cache =
+		cache_new(args.mapping, args.organization, args.cache_size);
+	if (!cache) {
+		printf("Unable to allocate the cache\n");
+		return 1;
+	}
+	timing_t timing;
+	if (args.timing && !timing_new(&timing, args.timing_config)) {
+		printf("Invalid timing configuration\n");
+		return 1;
+	}
+	tlb_t tlb;
+	if (args.tlb && !tlb_new(&tlb, args.tlb_config)) {
+		printf("Invalid TLB configuration\n");
+		return 1;
+	}
 
 	/* Open the file mem_trace.txt to read memory accesses */
 	FILE *ptr_file;
@@ -317,21 +656,38 @@ int main(int argc, char **argv) {
 	}
 
 	/* Loop until whole trace file has been read */
-	mem_access_t access;
+	// Accesses are collected and handed to the cache in batches.
+	mem_access_t accesses[TRACE_BATCH];
+	size_t accesses_len = 0;
 	while (1) {
-		access = read_transaction(ptr_file);
+		mem_access_t access = read_transaction(ptr_file);
 		// If no transactions left, break out of loop
 		if (access.address == 0) {
 			break;
 		}
 		printf("%d %x\n", access.type, access.address);
-		/* Do a cache access */
-		cache_access(&cache, access);
-		// ADD YOUR CODE HERE
+		if (args.timing || args.tlb) {
+			// The TLB and the timing model go access by access. A page walk
+			// holds up the access until it is done.
+			uint64_t walk = args.tlb ? tlb_access(&tlb, access) : 0;
+			cache_result_t result = cache_access(cache, access);
+			if (args.timing) {
+				timing_delay(&timing, walk);
+				timing_access(&timing, access, result);
+			}
+			continue;
+		}
+		accesses[accesses_len++] = access;
+		if (accesses_len == TRACE_BATCH) {
+			/* Do the cache accesses */
+			cache_access_batch(cache, accesses, accesses_len);
+			accesses_len = 0;
+		}
 	}
+	cache_access_batch(cache, accesses, accesses_len);
 
 	// We cannot change the lines below :shrug:
-	cache_stat_t cache_statistics = cache.stats;
+	cache_stat_t cache_statistics = cache_stats(cache);
 
 	/* Print the statistics */
 	// DO NOT CHANGE THE FOLLOWING LINES!
@@ -344,6 +700,15 @@ int main(int argc, char **argv) {
 	// DO NOT CHANGE UNTIL HERE
 	// You can extend the memory statistic printing if you like!
 	//
+	if (args.tlb) {
+		print_tlb(&tlb);
+		tlb_free(&tlb);
+	}
+	if (args.timing) {
+		print_timing(&timing, cache_statistics.accesses);
+		timing_free(&timing);
+	}
+	cache_free(cache);
 	/* Close the trace file */
 	fclose(ptr_file);
 	return 0;
@@ -0,0 +1,727 @@
+#include "libcachesim.h"
+
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// cache represents a cache.
+//
+// The lines are not stored as structs but as packed bit fields, each only as
+// wide as the geometry needs: the valid and dirty bits, the tag, and for FA
+// the FIFO rank of the line. All of them live in a single arena, backed by
+// huge pages when it is large enough.
+struct cache {
+	cache_map_t map;
+	cache_org_t org;
+	cache_stat_t stats;
+	// The total lines in cache (sum of all lines, even in split cache).
+	// Lines are split in two at midway point when using split cache.
+	uint32_t lines_len;
+	// Bits of the tag and of the FIFO rank of a line.
+	uint32_t tag_bits;
+	uint32_t rank_bits;
+	// Packed line fields: two flag bits (valid, dirty), tag_bits of tag and
+	// rank_bits of rank per line. They point into the arena.
+	uint64_t *flags;
+	uint64_t *tags;
+	uint64_t *ranks;
+	// Memory of the line fields, and whether it was mapped rather than
+	// allocated.
+	uint64_t *arena;
+	size_t arena_size;
+	bool arena_mapped;
+	// Union for mapping type specific values.
+	union {
+		// DM (direct mapping) values.
+		struct {
+			// How much to shift the address to the right in order for the
+			// tag to be at the least significant bit.
+			uint32_t dm_tag_shift;
+			// Bitmask for the index bits of the address.
+			uint32_t dm_index_mask;
+			// How many bits to shift the address to the right in order for
+			// the index to be at the least significant bit.
+			uint32_t dm_index_shift;
+			// Bitmask for the offset bits of the address.
+			uint32_t dm_offset_mask;
+		};
+		// FA (fully associative) values.
+		struct {
+			// How much to shift the address to the right in order for the
+			// tag to be at the least significant bit.
+			uint32_t fa_tag_shift;
+			// Bitmask for the offset bits of the address.
+			uint32_t fa_offset_mask;
+			// Stored rank of the oldest line of each organization (data,
+			// instructions). Ranks are kept relative to it, so that retiring
+			// the oldest line ages all others by moving the head only.
+			uint32_t fa_head[2];
+		};
+	};
+};
+
+// Arenas of at least this size are mapped and backed by huge pages where
+// possible, smaller ones come from the heap so that many small caches share
+// pages.
+#define ARENA_HUGE_PAGE (2 << 20)
+
+// Flag bits of a line.
+#define LINE_VALID 1
+#define LINE_DIRTY 2
+
+// Fields are packed little endian: field i occupies bits i * width up to
+// (i + 1) * width - 1 of the array, read as one little endian number. A field
+// is at most 32 bits wide, so the 8 bytes starting at its first byte hold it
+// whole, and it is read and written with a single unaligned load and store.
+// Arrays are padded by a word to make that load safe at their end.
+
+// bits_get returns field i of a packed array of width bit fields.
+static inline uint32_t bits_get(const uint64_t *words, uint64_t i,
+								uint32_t width) {
+	uint64_t pos = i * width;
+	uint64_t value;
+	memcpy(&value, (const char *)words + (pos >> 3), sizeof(value));
+	return (le64toh(value) >> (pos & 7)) & ((1ull << width) - 1);
+}
+
+// bits_set sets field i of a packed array of width bit fields.
+static inline void bits_set(uint64_t *words, uint64_t i, uint32_t width,
+							uint32_t value) {
+	uint64_t mask = (1ull << width) - 1;
+	uint64_t pos = i * width;
+	uint32_t shift = pos & 7;
+	char *bytes = (char *)words + (pos >> 3);
+	uint64_t word;
+	memcpy(&word, bytes, sizeof(word));
+	word = le64toh(word);
+	word = (word & ~(mask << shift)) | ((uint64_t)(value & mask) << shift);
+	word = htole64(word);
+	memcpy(bytes, &word, sizeof(word));
+}
+
+// flags_get returns the flag bits of a line. Being two bits wide, they never
+// straddle words.
+static inline uint32_t flags_get(const uint64_t *flags, uint32_t line) {
+	return (le64toh(flags[line >> 5]) >> ((line & 31) * 2)) & 3;
+}
+
+// bits_words returns the words needed for n fields of width bits, padding
+// included.
+static inline size_t bits_words(uint64_t n, uint32_t width) {
+	return (n * width + 63) / 64 + 1;
+}
+
+// arena_new allocates size bytes of zeroed memory. Large arenas try explicit
+// huge pages, then transparent huge pages, then the heap. The size is updated
+// to what was mapped.
+static uint64_t *arena_new(size_t *size, bool *mapped) {
+	*mapped = false;
+	if (*size >= ARENA_HUGE_PAGE) {
+		size_t huge =
+			(*size + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+		void *arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		arena = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+					 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (arena == MAP_FAILED) {
+			arena = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+						 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+			if (arena != MAP_FAILED) {
+				madvise(arena, huge, MADV_HUGEPAGE);
+			}
+#endif
+		}
+		if (arena != MAP_FAILED) {
+			*size = huge;
+			*mapped = true;
+			return arena;
+		}
+	}
+	return calloc(1, *size);
+}
+
+// cache_new creates a new cache with the specified mapping, organization and
+// size.
+cache_t *cache_new(cache_map_t map, cache_org_t org, uint32_t size) {
+	uint32_t lines_len = size / CACHESIM_LINE_SIZE;
+	cache_t *cache = malloc(sizeof(cache_t));
+	if (!cache) {
+		return NULL;
+	}
+	// Initialize cache struct.
+	*cache = (cache_t){
+		.map = map,
+		.org = org,
+		.stats = { 0 },
+		.lines_len = lines_len,
+	};
+	// Organized lines are halved in split cache. One for instructions, and one
+	// for data.
+	uint32_t org_lines_len =
+		cache->org == cache_uc ? cache->lines_len : (cache->lines_len / 2);
+	switch (cache->map) {
+	case cache_dm:
+		// Set up the cache as a DM cache.
+		// subtract one gives us mask for powers of two.
+		cache->dm_offset_mask = CACHESIM_LINE_SIZE - 1;
+		cache->dm_index_shift = __builtin_popcount(cache->dm_offset_mask);
+		cache->dm_index_mask = (org_lines_len - 1) << cache->dm_index_shift;
+		cache->dm_tag_shift =
+			cache->dm_index_shift + __builtin_popcount(cache->dm_index_mask);
+		cache->tag_bits = 32 - cache->dm_tag_shift;
+		break;
+	case cache_fa:
+		// Set up the cache as a FA cache.
+		// subtract one gives us mask for powers of two.
+		cache->fa_offset_mask = CACHESIM_LINE_SIZE - 1;
+		cache->fa_tag_shift = __builtin_popcount(cache->fa_offset_mask);
+		cache->tag_bits = 32 - cache->fa_tag_shift;
+		// A rank orders the lines of one organization by age.
+		cache->rank_bits = __builtin_popcount(org_lines_len - 1);
+		break;
+	}
+
+	// Lay out the line fields one after another in the arena.
+	size_t flags_words = bits_words(lines_len, 2);
+	size_t tags_words = bits_words(lines_len, cache->tag_bits);
+	size_t ranks_words = bits_words(lines_len, cache->rank_bits);
+	cache->arena_size = (flags_words + tags_words + ranks_words) * 8;
+	cache->arena = arena_new(&cache->arena_size, &cache->arena_mapped);
+	if (!cache->arena) {
+		free(cache);
+		return NULL;
+	}
+	cache->flags = cache->arena;
+	cache->tags = cache->flags + flags_words;
+	cache->ranks = cache->tags + tags_words;
+
+	return cache;
+}
+
+// cache_line_hit returns whether the line is valid and holds the tag.
+static inline bool cache_line_hit(cache_t *cache, uint32_t line, uint32_t tag) {
+	return (flags_get(cache->flags, line) & LINE_VALID) &&
+		   bits_get(cache->tags, line, cache->tag_bits) == tag;
+}
+
+// cache_line_fill replaces the line with the tag, reporting the old line in
+// the result.
+static inline void cache_line_fill(cache_t *cache, uint32_t line, uint32_t tag,
+								   bool write, cache_result_t *result) {
+	uint32_t flags = flags_get(cache->flags, line);
+	result->evicted = flags & LINE_VALID;
+	result->dirty = result->evicted && (flags & LINE_DIRTY);
+	bits_set(cache->flags, line, 2, LINE_VALID | (write ? LINE_DIRTY : 0));
+	bits_set(cache->tags, line, cache->tag_bits, tag);
+}
+
+// cache_line_write marks the line dirty.
+static inline void cache_line_write(cache_t *cache, uint32_t line) {
+	bits_set(cache->flags, line, 2, LINE_VALID | LINE_DIRTY);
+}
+
+// cache_access_dm performs a DM cache access on the provided lines.
+static inline cache_result_t cache_access_dm(cache_t *cache,
+											 mem_access_t access,
+											 uint32_t lines_beg,
+											 uint32_t lines_len) {
+	uint32_t tag = access.address >> cache->dm_tag_shift;
+	uint32_t index =
+		(access.address & cache->dm_index_mask) >> cache->dm_index_shift;
+	uint32_t offset = access.address & cache->dm_offset_mask;
+
+	// Check for hit, or evict & replace.
+	cache_result_t result = { .line = lines_beg + index };
+	if (cache_line_hit(cache, result.line, tag)) {
+		// Cache hit!
+		cache->stats.hits++;
+		result.hit = true;
+		if (access.write) {
+			cache_line_write(cache, result.line);
+		}
+	} else {
+		// Cache miss!
+		cache_line_fill(cache, result.line, tag, access.write, &result);
+	}
+	return result;
+}
+
+// cache_access_fa performs a FA cache access on the provided lines.
+// It uses a FIFO eviction policy. The valid lines are ranked by age, 0 being
+// the oldest, and the ranks are stored relative to the head of the lines.
+static inline cache_result_t cache_access_fa(cache_t *cache,
+											 mem_access_t access,
+											 uint32_t lines_beg,
+											 uint32_t lines_len) {
+	uint32_t tag = access.address >> cache->fa_tag_shift;
+	uint32_t offset = access.address & cache->fa_offset_mask;
+	uint32_t lines_end = lines_beg + lines_len;
+	uint32_t *head = &cache->fa_head[lines_beg != 0];
+
+	// Search for a valid cache line with the correct tag, noting the first
+	// invalid line on the way.
+	cache_result_t result = { 0 };
+	uint32_t invalid = lines_end;
+	uint32_t valid_len = 0;
+	for (uint32_t i = lines_beg; i < lines_end; i++) {
+		if (!(flags_get(cache->flags, i) & LINE_VALID)) {
+			if (invalid == lines_end) {
+				invalid = i;
+			}
+			continue;
+		}
+		if (bits_get(cache->tags, i, cache->tag_bits) == tag) {
+			// Cache hit!
+			cache->stats.hits++;
+			result.hit = true;
+			result.line = i;
+			if (access.write) {
+				cache_line_write(cache, i);
+			}
+			return result;
+		}
+		valid_len++;
+	}
+
+	// Cache miss!
+	// Evist oldest line or the first invalid line (FIFO).
+	// Replace that line with the provided line, as the newest.
+	if (invalid != lines_end) {
+		result.line = invalid;
+		bits_set(cache->ranks, invalid, cache->rank_bits,
+				 (*head + valid_len) & (lines_len - 1));
+	} else {
+		// The oldest line becomes the newest, which keeps its stored rank
+		// and moves the head to the next oldest.
+		for (uint32_t i = lines_beg; i < lines_end; i++) {
+			if (bits_get(cache->ranks, i, cache->rank_bits) == *head) {
+				result.line = i;
+				break;
+			}
+		}
+		*head = (*head + 1) & (lines_len - 1);
+	}
+	cache_line_fill(cache, result.line, tag, access.write, &result);
+	return result;
+}
+
+// cache_lines determines the lines which are accessible by the access.
+// * UC - Full access to all lines
+// * SC - Half of lines to instructions, other half for data.
+static inline void cache_lines(cache_t *cache, mem_access_t access,
+							   uint32_t *lines_beg, uint32_t *lines_len) {
+	switch (cache->org) {
+	case cache_uc:
+		*lines_beg = 0;
+		*lines_len = cache->lines_len;
+		break;
+	case cache_sc:
+		*lines_len = cache->lines_len >> 1;
+		*lines_beg = access.type == access_instruction ? *lines_len : 0;
+		break;
+	}
+}
+
+// cache_access performs a cache access.
+cache_result_t cache_access(cache_t *cache, mem_access_t access) {
+	uint32_t lines_beg;
+	uint32_t lines_len;
+	cache_lines(cache, access, &lines_beg, &lines_len);
+
+	// Run the respective cache access function.
+	cache_result_t result;
+	switch (cache->map) {
+	case cache_fa:
+		result = cache_access_fa(cache, access, lines_beg, lines_len);
+		break;
+	case cache_dm:
+		result = cache_access_dm(cache, access, lines_beg, lines_len);
+		break;
+	}
+
+	cache->stats.accesses++;
+	return result;
+}
+
+// cache_access_batch_map performs the accesses with the mapping known up
+// front. Being inlined with a constant mapping, the dispatch on it vanishes
+// from the loop.
+static inline __attribute__((always_inline)) void
+cache_access_batch_map(cache_t *cache, const mem_access_t *accesses, size_t n,
+					   cache_map_t map) {
+	for (size_t i = 0; i < n; i++) {
+		uint32_t lines_beg;
+		uint32_t lines_len;
+		cache_lines(cache, accesses[i], &lines_beg, &lines_len);
+		if (map == cache_dm) {
+			cache_access_dm(cache, accesses[i], lines_beg, lines_len);
+		} else {
+			cache_access_fa(cache, accesses[i], lines_beg, lines_len);
+		}
+	}
+}
+
+uint64_t cache_access_batch(cache_t *cache, const mem_access_t *accesses,
+							size_t n) {
+	uint64_t hits = cache->stats.hits;
+	switch (cache->map) {
+	case cache_dm:
+		cache_access_batch_map(cache, accesses, n, cache_dm);
+		break;
+	case cache_fa:
+		cache_access_batch_map(cache, accesses, n, cache_fa);
+		break;
+	}
+	cache->stats.accesses += n;
+	return cache->stats.hits - hits;
+}
+
+// cache_lookup returns the index of the line holding the address of the
+// access, or -1 if it is not cached. Unlike cache_access, it has no effect on
+// the cache or its statistics.
+int64_t cache_lookup(cache_t *cache, mem_access_t access) {
+	uint32_t lines_beg;
+	uint32_t lines_len;
+	cache_lines(cache, access, &lines_beg, &lines_len);
+
+	switch (cache->map) {
+	case cache_fa: {
+		uint32_t tag = access.address >> cache->fa_tag_shift;
+		for (uint32_t i = lines_beg; i < lines_beg + lines_len; i++) {
+			if (cache_line_hit(cache, i, tag)) {
+				return i;
+			}
+		}
+		break;
+	}
+	case cache_dm: {
+		uint32_t tag = access.address >> cache->dm_tag_shift;
+		uint32_t index =
+			(access.address & cache->dm_index_mask) >> cache->dm_index_shift;
+		if (cache_line_hit(cache, lines_beg + index, tag)) {
+			return lines_beg + index;
+		}
+		break;
+	}
+	}
+	return -1;
+}
+
+// cache_invalidate invalidates the line at the provided index.
+void cache_invalidate(cache_t *cache, uint32_t line) {
+	if (!(flags_get(cache->flags, line) & LINE_VALID)) {
+		return;
+	}
+	if (cache->map == cache_fa) {
+		// The lines newer than the invalidated one move up a rank, keeping
+		// the ranks of the valid lines dense.
+		uint32_t lines_len =
+			cache->org == cache_uc ? cache->lines_len : cache->lines_len / 2;
+		uint32_t lines_beg = line - line % lines_len;
+		uint32_t mask = lines_len - 1;
+		uint32_t head = cache->fa_head[lines_beg != 0];
+		uint32_t rank =
+			(bits_get(cache->ranks, line, cache->rank_bits) - head) & mask;
+		for (uint32_t i = lines_beg; i < lines_beg + lines_len; i++) {
+			uint32_t other = bits_get(cache->ranks, i, cache->rank_bits);
+			if ((flags_get(cache->flags, i) & LINE_VALID) &&
+				((other - head) & mask) > rank) {
+				bits_set(cache->ranks, i, cache->rank_bits, other - 1);
+			}
+		}
+	}
+	bits_set(cache->flags, line, 2, 0);
+}
+
+cache_stat_t cache_stats(const cache_t *cache) { return cache->stats; }
+
+void cache_free(cache_t *cache) {
+	if (cache->arena_mapped) {
+		munmap(cache->arena, cache->arena_size);
+	} else {
+		free(cache->arena);
+	}
+	free(cache);
+}
+
+bool timing_new(timing_t *timing, timing_config_t config) {
+	bool pow2_banks =
+		config.mem_banks && !(config.mem_banks & (config.mem_banks - 1));
+	bool pow2_row =
+		config.row_size && !(config.row_size & (config.row_size - 1));
+	if (!pow2_banks || !pow2_row || config.row_size < CACHESIM_LINE_SIZE ||
+		config.mshrs == 0 || config.mshrs > TIMING_MAX_MSHRS) {
+		return false;
+	}
+	*timing = (timing_t){
+		.config = config,
+		.open_rows = malloc(config.mem_banks * sizeof(uint32_t)),
+		.bank_free = calloc(config.mem_banks, sizeof(uint64_t)),
+	};
+	for (uint32_t i = 0; i < config.mem_banks; i++) {
+		timing->open_rows[i] = UINT32_MAX;
+	}
+	return true;
+}
+
+// timing_memory fetches the line of the address from memory, starting no
+// earlier than cycle start. Returns the cycle the line arrives in.
+static uint64_t timing_memory(timing_t *timing, uint32_t address,
+							  uint64_t start) {
+	timing_config_t *config = &timing->config;
+	// Consecutive lines go to consecutive banks, and a row holds row_size
+	// bytes of every bank.
+	uint32_t line = address / CACHESIM_LINE_SIZE;
+	uint32_t bank = line & (config->mem_banks - 1);
+	uint32_t row = line / config->mem_banks / (config->row_size / CACHESIM_LINE_SIZE);
+
+	if (timing->bank_free[bank] > start) {
+		start = timing->bank_free[bank];
+	}
+	uint32_t latency;
+	if (timing->open_rows[bank] == row) {
+		timing->stats.row_hits++;
+		latency = config->row_hit_latency;
+	} else {
+		timing->stats.row_misses++;
+		latency = config->row_miss_latency;
+		timing->open_rows[bank] = row;
+	}
+	timing->bank_free[bank] = start + latency;
+	return start + latency;
+}
+
+uint64_t timing_access(timing_t *timing, mem_access_t access,
+					   cache_result_t result) {
+	timing_config_t *config = &timing->config;
+	uint64_t issue = timing->now;
+	uint64_t done;
+	// An access to a line still on its way from memory waits for that miss,
+	// whether the cache counts it as a hit or not.
+	uint32_t line = access.address / CACHESIM_LINE_SIZE;
+	uint32_t merged = config->mshrs;
+	for (uint32_t i = 0; i < config->mshrs; i++) {
+		if (timing->mshr_done[i] > issue && timing->mshr_line[i] == line) {
+			merged = i;
+			break;
+		}
+	}
+	if (merged < config->mshrs) {
+		timing->stats.mshr_merges++;
+		done = issue + config->hit_latency;
+		if (timing->mshr_done[merged] > done) {
+			done = timing->mshr_done[merged];
+		}
+	} else if (result.hit) {
+		done = issue + config->hit_latency;
+	} else {
+		// Take the MSHR freeing up first, stalling if all are busy.
+		uint32_t mshr = 0;
+		for (uint32_t i = 1; i < config->mshrs; i++) {
+			if (timing->mshr_done[i] < timing->mshr_done[mshr]) {
+				mshr = i;
+			}
+		}
+		if (timing->mshr_done[mshr] > issue) {
+			timing->stats.stall_cycles += timing->mshr_done[mshr] - issue;
+			issue = timing->mshr_done[mshr];
+		}
+		done = timing_memory(timing, access.address,
+							 issue + config->hit_latency);
+		timing->mshr_done[mshr] = done;
+		timing->mshr_line[mshr] = line;
+	}
+
+	// The access was issued before the delay that held it up.
+	uint64_t latency = done - issue + timing->delay;
+	timing->delay = 0;
+	timing->stats.total_latency += latency;
+	uint32_t bucket = latency ? 63 - __builtin_clzll(latency) : 0;
+	if (bucket >= TIMING_HIST_LEN) {
+		bucket = TIMING_HIST_LEN - 1;
+	}
+	timing->stats.hist[bucket]++;
+	if (done > timing->stats.cycles) {
+		timing->stats.cycles = done;
+	}
+	timing->now = issue + 1;
+	return latency;
+}
+
+void timing_free(timing_t *timing) {
+	free(timing->open_rows);
+	free(timing->bank_free);
+}
+
+void timing_delay(timing_t *timing, uint64_t cycles) {
+	timing->now += cycles;
+	timing->delay += cycles;
+	if (timing->now > timing->stats.cycles) {
+		timing->stats.cycles = timing->now;
+	}
+}
+
+bool tlb_new(tlb_t *tlb, tlb_config_t config) {
+	uint32_t halves = config.org == cache_sc ? 2 : 1;
+	bool pow2_entries =
+		config.entries && !(config.entries & (config.entries - 1));
+	bool pow2_ways = config.ways && !(config.ways & (config.ways - 1));
+	bool pow2_page =
+		config.page_size && !(config.page_size & (config.page_size - 1));
+	if (!pow2_entries || !pow2_ways || !pow2_page ||
+		config.ways * halves > config.entries || config.page_size < 4096) {
+		return false;
+	}
+	uint32_t page_shift = __builtin_ctz(config.page_size);
+	if (config.walk_levels == 0) {
+		config.walk_levels = (32 - page_shift + 9) / 10;
+	}
+	*tlb = (tlb_t){
+		.config = config,
+		.entries = calloc(config.entries, sizeof(tlb_entry_t)),
+		.sets = config.entries / halves / config.ways,
+		.page_shift = page_shift,
+	};
+	return true;
+}
+
+uint64_t tlb_access(tlb_t *tlb, mem_access_t access) {
+	uint32_t page = access.address >> tlb->page_shift;
+	uint32_t set = page & (tlb->sets - 1);
+	uint32_t ways = tlb->config.ways;
+	tlb_entry_t *entries = &tlb->entries[set * ways];
+	// Instructions take the upper half of a split TLB.
+	if (tlb->config.org == cache_sc && access.type == access_instruction) {
+		entries += tlb->config.entries / 2;
+	}
+
+	tlb->time++;
+	tlb->stats.accesses[access.type]++;
+	tlb_entry_t *victim = &entries[0];
+	for (uint32_t i = 0; i < ways; i++) {
+		if (entries[i].valid && entries[i].page == page) {
+			tlb->stats.hits[access.type]++;
+			entries[i].used = tlb->time;
+			return 0;
+		}
+		// Prefer invalid entries, then the least recently used one.
+		if (victim->valid &&
+			(!entries[i].valid || entries[i].used < victim->used)) {
+			victim = &entries[i];
+		}
+	}
+
+	*victim = (tlb_entry_t){ .valid = true, .page = page, .used = tlb->time };
+	uint64_t cycles =
+		(uint64_t)tlb->config.walk_levels * tlb->config.walk_latency;
+	tlb->stats.walks++;
+	tlb->stats.walk_cycles += cycles;
+	return cycles;
+}
+
+void tlb_free(tlb_t *tlb) { free(tlb->entries); }
+
+coh_core_t coh_core_new(cache_map_t map, cache_org_t org, uint32_t size) {
+	coh_core_t core = { .cache = cache_new(map, org, size) };
+	if (!core.cache) {
+		return core;
+	}
+	core.states = calloc(core.cache->lines_len, sizeof(uint8_t));
+	core.touched = calloc(core.cache->lines_len, sizeof(uint16_t));
+	return core;
+}
+
+// coh_snoop runs a bus transaction of core self for the access on all other
+// cores. Returns whether any other core holds the line.
+static bool coh_snoop(coh_core_t *cores, uint32_t cores_len, uint32_t self,
+					  mem_access_t access, bool exclusive) {
+	uint16_t word = 1 << ((access.address & (CACHESIM_LINE_SIZE - 1)) / CACHESIM_WORD_SIZE);
+	bool shared = false;
+	for (uint32_t i = 0; i < cores_len; i++) {
+		if (i == self) {
+			continue;
+		}
+		coh_core_t *other = &cores[i];
+		int64_t line = cache_lookup(other->cache, access);
+		if (line < 0) {
+			continue;
+		}
+		shared = true;
+		uint8_t *state = &other->states[line];
+		// The owner of a modified line supplies it and, unless the requester
+		// takes it over as modified, writes it back. With MESI an exclusive
+		// line is supplied as well.
+		if (*state == coh_modified || *state == coh_exclusive) {
+			other->stats.c2c_transfers++;
+			if (*state == coh_modified && !exclusive) {
+				other->stats.writebacks++;
+			}
+		}
+		if (exclusive) {
+			other->stats.invalidations++;
+			if (!(other->touched[line] & word)) {
+				other->stats.false_sharing++;
+			}
+			*state = coh_invalid;
+			cache_invalidate(other->cache, line);
+		} else {
+			*state = coh_shared;
+		}
+	}
+	return shared;
+}
+
+void coh_access(coh_core_t *cores, uint32_t cores_len, uint32_t self,
+				coh_protocol_t protocol, mem_access_t access) {
+	coh_core_t *core = &cores[self];
+	uint8_t state = coh_invalid;
+	int64_t line = cache_lookup(core->cache, access);
+	if (line >= 0) {
+		state = core->states[line];
+	}
+
+	if (state == coh_invalid) {
+		// Read miss: BusRd, exclusive if nobody else has it (MESI only).
+		// Write miss: BusRdX, invalidating all other copies.
+		if (access.write) {
+			core->stats.bus_read_exclusives++;
+			coh_snoop(cores, cores_len, self, access, true);
+			state = coh_modified;
+		} else {
+			core->stats.bus_reads++;
+			bool shared = coh_snoop(cores, cores_len, self, access, false);
+			state = shared || protocol == coh_msi ? coh_shared : coh_exclusive;
+		}
+	} else if (access.write) {
+		// Write hit: shared lines need a BusUpgr, exclusive lines become
+		// modified silently.
+		if (state == coh_shared) {
+			core->stats.bus_upgrades++;
+			coh_snoop(cores, cores_len, self, access, true);
+		}
+		state = coh_modified;
+	}
+
+	cache_result_t result = cache_access(core->cache, access);
+	if (!result.hit) {
+		// The replaced line is written back if it was modified.
+		if (result.evicted && core->states[result.line] == coh_modified) {
+			core->stats.writebacks++;
+		}
+		core->touched[result.line] = 0;
+	}
+	core->states[result.line] = state;
+	core->touched[result.line] |=
+		1 << ((access.address & (CACHESIM_LINE_SIZE - 1)) / CACHESIM_WORD_SIZE);
+}
+
+void coh_core_free(coh_core_t *core) {
+	free(core->states);
+	free(core->touched);
+	if (core->cache) {
+		cache_free(core->cache);
+	}
+}
@@ -0,0 +1,267 @@
+// libcachesim simulates single level caches, in-process.
+//
+// A cache is created with cache_new, fed with cache_access or
+// cache_access_batch and released with cache_free. The statistics are read
+// with cache_stats.
+#ifndef LIBCACHESIM_H
+#define LIBCACHESIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Version of the API, bumped on incompatible changes.
+#define CACHESIM_API_VERSION 3
+
+#define CACHESIM_LINE_SIZE 64
+
+typedef enum { cache_dm, cache_fa } cache_map_t;
+typedef enum { cache_uc, cache_sc } cache_org_t;
+typedef enum { access_instruction, access_data } access_t;
+
+typedef struct {
+	uint32_t address;
+	access_t type;
+	// Whether a data access writes, which makes the line dirty.
+	bool write;
+} mem_access_t;
+
+// mem_record_t is the binary trace record, in host byte order.
+typedef struct {
+	uint32_t address;
+	// Access type as in text traces: 'I', 'D', 'R' or 'W'.
+	char type;
+	char reserved[3];
+} mem_record_t;
+
+typedef struct {
+	uint64_t accesses;
+	uint64_t hits;
+} cache_stat_t;
+
+// cache_t represents a cache. Its layout is private to the library, so that
+// it can change without breaking tools built against this header.
+typedef struct cache cache_t;
+
+// cache_result_t describes the outcome of a cache access.
+typedef struct {
+	bool hit;
+	// Whether a valid line was replaced, and whether it was dirty.
+	bool evicted;
+	bool dirty;
+	// Index of the accessed line.
+	uint32_t line;
+} cache_result_t;
+
+// Timing
+// A cycle-level estimate of the cost of the accesses to a cache. Accesses
+// are issued in order, one per cycle. Hits take the hit latency, and a hit
+// may proceed under outstanding misses. Misses need a free MSHR, and the
+// issue stalls until one frees up. Missing lines are fetched from a banked
+// memory with a row buffer per bank: a row hit is cheaper than opening a new
+// row, and a busy bank queues the request.
+
+// Number of power of two buckets of the latency histogram.
+#define TIMING_HIST_LEN 16
+// Upper limit of outstanding misses.
+#define TIMING_MAX_MSHRS 64
+
+typedef struct {
+	// Cycles of a cache hit, also spent on a miss before memory is asked.
+	uint32_t hit_latency;
+	// Cycles of a memory access to the open row of a bank, and to another
+	// row.
+	uint32_t row_hit_latency;
+	uint32_t row_miss_latency;
+	// Memory banks, power of two. Lines are interleaved across the banks.
+	uint32_t mem_banks;
+	// Bytes in a row of a bank, power of two and at least CACHESIM_LINE_SIZE.
+	uint32_t row_size;
+	// Outstanding misses the cache can track, up to TIMING_MAX_MSHRS.
+	uint32_t mshrs;
+} timing_config_t;
+
+typedef struct {
+	// Sum of the latencies of all accesses, from issue to completion.
+	uint64_t total_latency;
+	// Cycles the issue was blocked waiting for an MSHR.
+	uint64_t stall_cycles;
+	// Cycles until the last access completed.
+	uint64_t cycles;
+	// Accesses to a line whose miss was still outstanding, which complete
+	// with that miss.
+	uint64_t mshr_merges;
+	uint64_t row_hits;
+	uint64_t row_misses;
+	// hist[i] counts accesses with latency in [2^i, 2^(i+1)), the last bucket
+	// everything above.
+	uint64_t hist[TIMING_HIST_LEN];
+} timing_stat_t;
+
+// timing_t holds the timing state of a cache.
+typedef struct {
+	timing_config_t config;
+	timing_stat_t stats;
+	// Cycle the next access is issued in, and the cycles it was held up by
+	// timing_delay before that.
+	uint64_t now;
+	uint64_t delay;
+	// Cycles the outstanding misses complete in, and their line addresses.
+	uint64_t mshr_done[TIMING_MAX_MSHRS];
+	uint32_t mshr_line[TIMING_MAX_MSHRS];
+	// Per bank: open row, or UINT32_MAX when closed, and the cycle the bank
+	// is free again.
+	uint32_t *open_rows;
+	uint64_t *bank_free;
+} timing_t;
+
+// TLB
+// A set-associative TLB with LRU replacement, looked up before the cache.
+// Translations are identities, so the cache sees the same addresses either
+// way; the TLB only adds its statistics and the cost of the page walks. A
+// split TLB gives half of its entries to instructions, like a split cache.
+
+typedef struct {
+	// Entries in total and per set, powers of two.
+	uint32_t entries;
+	uint32_t ways;
+	cache_org_t org;
+	// Bytes in a page, power of two of at least 4096.
+	uint32_t page_size;
+	// Levels of the page table, read one after another on a miss. 0 derives
+	// them from the page size, with 10 bits of address per level as in a
+	// 32-bit two level page table.
+	uint32_t walk_levels;
+	// Cycles to read one level of the page table.
+	uint32_t walk_latency;
+} tlb_config_t;
+
+typedef struct {
+	// Per access type.
+	uint64_t accesses[2];
+	uint64_t hits[2];
+	uint64_t walks;
+	uint64_t walk_cycles;
+} tlb_stat_t;
+
+typedef struct {
+	bool valid;
+	uint32_t page;
+	// Time of the last use, for LRU.
+	uint64_t used;
+} tlb_entry_t;
+
+// tlb_t represents a TLB.
+typedef struct {
+	tlb_config_t config;
+	tlb_stat_t stats;
+	tlb_entry_t *entries;
+	// Sets of each half in a split TLB, of the whole otherwise.
+	uint32_t sets;
+	uint32_t page_shift;
+	// Increases by 1 for every access.
+	uint64_t time;
+} tlb_t;
+
+typedef enum { coh_msi, coh_mesi } coh_protocol_t;
+
+// Coherence
+// Every core has a private cache built with cache_new, kept coherent by a
+// snooping MSI or MESI protocol on a shared bus. The protocol state of each
+// line is kept next to the cache, indexed like the lines of the cache.
+
+// Size of a word for the false sharing detection.
+#define CACHESIM_WORD_SIZE 4
+
+typedef enum { coh_invalid, coh_shared, coh_exclusive, coh_modified } coh_state_t;
+
+// coh_stat_t holds the coherence statistics of a core.
+typedef struct {
+	// Bus transactions issued by the core.
+	uint64_t bus_reads;
+	uint64_t bus_read_exclusives;
+	uint64_t bus_upgrades;
+	// Lines of this core invalidated by writes of other cores, and how many
+	// of those were false sharing: the core never touched the written word.
+	uint64_t invalidations;
+	uint64_t false_sharing;
+	// Lines this core supplied to other cores.
+	uint64_t c2c_transfers;
+	// Modified lines written back to memory, on eviction or when shared.
+	uint64_t writebacks;
+} coh_stat_t;
+
+
+// coh_core_t represents a core with its private cache.
+typedef struct {
+	cache_t *cache;
+	// Protocol state of every line.
+	uint8_t *states;
+	// Words touched by the core in every line since it was filled, one bit
+	// per word.
+	uint16_t *touched;
+	coh_stat_t stats;
+} coh_core_t;
+
+// cache_new creates a new cache with the specified mapping, organization and
+// size. Returns NULL if its memory could not be allocated.
+cache_t *cache_new(cache_map_t map, cache_org_t org, uint32_t size);
+
+// cache_stats returns the statistics of all accesses so far.
+cache_stat_t cache_stats(const cache_t *cache);
+
+// cache_access performs a cache access.
+cache_result_t cache_access(cache_t *cache, mem_access_t access);
+
+// cache_access_batch performs the accesses in order, and returns how many of
+// them hit. It dispatches on the mapping once for the whole batch, which makes
+// it cheaper than calling cache_access for every access.
+uint64_t cache_access_batch(cache_t *cache, const mem_access_t *accesses,
+							size_t n);
+
+// cache_lookup returns the index of the line holding the address of the
+// access, or -1 if it is not cached. Unlike cache_access, it has no effect on
+// the cache or its statistics.
+int64_t cache_lookup(cache_t *cache, mem_access_t access);
+
+// cache_invalidate invalidates the line at the provided index.
+void cache_invalidate(cache_t *cache, uint32_t line);
+
+void cache_free(cache_t *cache);
+
+// timing_new creates the timing state for a cache. Returns false if the
+// configuration is invalid.
+bool timing_new(timing_t *timing, timing_config_t config);
+
+// timing_access accounts an access of the provided result, and returns its
+// latency in cycles.
+uint64_t timing_access(timing_t *timing, mem_access_t access,
+					   cache_result_t result);
+
+void timing_free(timing_t *timing);
+
+// timing_delay holds up the next access for the provided cycles, like a page
+// walk does. The cycles count towards the latency of that access.
+void timing_delay(timing_t *timing, uint64_t cycles);
+
+// tlb_new creates a TLB. Returns false if the configuration is invalid.
+bool tlb_new(tlb_t *tlb, tlb_config_t config);
+
+// tlb_access translates the address of the access, walking the page table on
+// a miss. Returns the cycles spent walking, 0 on a hit.
+uint64_t tlb_access(tlb_t *tlb, mem_access_t access);
+
+void tlb_free(tlb_t *tlb);
+
+// coh_core_new creates a core with a cache as made by cache_new. Its cache is
+// NULL if its memory could not be allocated.
+coh_core_t coh_core_new(cache_map_t map, cache_org_t org, uint32_t size);
+
+// coh_access performs an access of core self, including the bus transactions
+// needed to keep the caches of all cores coherent.
+void coh_access(coh_core_t *cores, uint32_t cores_len, uint32_t self,
+				coh_protocol_t protocol, mem_access_t access);
+
+void coh_core_free(coh_core_t *core);
+
+#endif
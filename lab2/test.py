@@ -1,74 +1,111 @@
 from os import listdir
-from os.path import splitext, join
+from os.path import exists, splitext, join
+import re
 import subprocess
+import sys
 
 TESTCASE_DIR = "testcases"
 
+# A statistic line, "Key: value".
+STAT_LINE = re.compile(r"^([^:]+):\s*(.*?)\s*$")
+
 class Test:
-    def __init__(self, name, args, accesses, hits) -> None:
+    def __init__(self, name, args, stats) -> None:
         self.name = name;
         self.args = args;
-        self.accesses = accesses;
-        self.hits = hits;
-        
+        self.stats = stats;
+
+
+
+def parse_stats(lines):
+    stats = list()
+    for line in lines:
+        match = STAT_LINE.match(line)
+        if match:
+            stats.append((match.group(1).strip(), match.group(2)))
+    return stats
+
+
+def parse_command(line):
+    # Trace files named in the command live in the testcase directory,
+    # including the comma separated ones of --cores.
+    args = list()
+    for frag in line.strip("#> \n").split()[1:]:
+        parts = frag.split(",")
+        parts = [join(TESTCASE_DIR, p) if exists(join(TESTCASE_DIR, p)) else p
+                 for p in parts]
+        args.append(",".join(parts))
+    return tuple(args)
 
 
 def get_tests():
-    names = set(map(lambda x: splitext(x)[0], listdir(TESTCASE_DIR)))
-    sorted_names = sorted(names)
+    # Every .out file holds one or more "#> command" lines, each followed by
+    # the output it should print.
+    names = sorted(splitext(x)[0] for x in listdir(TESTCASE_DIR)
+                   if x.endswith(".out"))
     tests = list()
-    for name in sorted_names:
-        input = join(TESTCASE_DIR, name) + ".txt"
+    for name in names:
         out = join(TESTCASE_DIR, name) + ".out"
         args = None
-        accesses = None
-        hits = None
+        block = list()
         i = 1
         with open(out) as of:
             for line in of:
-                if line.startswith("#>"): 
-                    frags = line.strip("#> ").split(" ")
-                    args = (frags[1], frags[2], frags[3], input)
-                elif line.startswith("Accesses:"):
-                    accesses = int(line.split(":")[1])
-                elif line.startswith("Hits:"):
-                    hits = int(line.split(":")[1])
-                    tests.append(Test(f"{name} #{i}", args, accesses, hits))
-                    i += 1
-            tests.append(Test(f"{name} #{i}", args, accesses, hits))
+                if line.startswith("#>"):
+                    if args is not None:
+                        tests.append(Test(f"{name} #{i}", args, parse_stats(block)))
+                        i += 1
+                    args = parse_command(line)
+                    block = list()
+                else:
+                    block.append(line)
+        if args is not None:
+            tests.append(Test(f"{name} #{i}", args, parse_stats(block)))
 
     return tests
-        
+
 
 def run_test(test: Test):
     print(f"running test {test.name}...", end = "")
     cmd = subprocess.run(("./cache_sim", *test.args), capture_output=True, check=True)
-    accesses = None
-    hits = None
-    for line in cmd.stdout.splitlines():
-        if line.startswith(b"Accesses:"):
-            accesses = int(line.split(b":")[1])
-        elif line.startswith(b"Hits:"):
-            hits = int(line.split(b":")[1])
-    
+    stats = parse_stats(cmd.stdout.decode().splitlines())
+
+    # The sample outputs show more than cache_sim prints, so only the
+    # statistics both have are compared, in order. Accesses and hits must
+    # always be there.
+    keys = set(k for k, _ in stats)
+    want_keys = set(k for k, _ in test.stats)
+    got = [s for s in stats if s[0] in want_keys]
+    want = [s for s in test.stats if s[0] in keys]
+
     error = ""
-    if test.hits != hits:
-        error += f"hits {hits}, want {test.hits}\n"
-    if test.accesses != accesses:
-        error += f"accesses {accesses}, want {test.accesses}\n"
+    for key in ("Accesses", "Hits"):
+        if key not in keys or key not in want_keys:
+            error += f"no {key}\n"
+    for (key, value), (_, want_value) in zip(got, want):
+        if value != want_value:
+            error += f"{key} {value}, want {want_value}\n"
+    if len(got) != len(want):
+        error += f"{len(got)} statistics, want {len(want)}\n"
     if error:
         print(f" ERROR\n{error}")
-    else:
-        print(" OK")
+        return False
+    print(" OK")
+    return True
 
 
 
 
 def main():
     tests = get_tests()
+    failed = 0
     for test in tests:
-        run_test(test)
-    
+        if not run_test(test):
+            failed += 1
+    if failed:
+        print(f"{failed} of {len(tests)} tests failed")
+        sys.exit(1)
+
 
 if __name__ == "__main__":
     main();
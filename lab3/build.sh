@@ -0,0 +1,3 @@
+#!/bin/sh
+
+gcc -O2 stetris.c -o stetris -pthread
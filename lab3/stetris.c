@@ -8,10 +8,13 @@
 #include <string.h>
 #include <time.h>
 #include <poll.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <linux/fb.h>
 #include <linux/input.h>
 
@@ -59,10 +62,12 @@ typedef struct {
 															// when reached 0, next game state calculated
 	unsigned long nextGameTick; // sets when tick is wrapping back to zero
 															// lowers with increasing level, never reaches 0
+	unsigned int cpickerIdx;    // next color of the color picker
 } gameConfig;
 
 
-
+// game is the instance played interactively, headless and by the bot. The
+// game server uses it as the template for its own instances.
 gameConfig game = {
 									 .grid = {8, 8},
 									 .uSecTickTime = 10000,
@@ -89,6 +94,13 @@ typedef struct senseHatPixel {
 	char r : SENSE_HAT_FB_R_BITS;
 } __attribute__((aligned(1), packed)) senseHatPixel;
 senseHatPixel *senseHatFb;
+// dimensions of the mapped framebuffer, which may be virtual
+unsigned int senseHatFbWidth = SENSE_HAT_FB_WIDTH;
+unsigned int senseHatFbHeight = SENSE_HAT_FB_HEIGHT;
+
+static inline size_t senseHatFbSize() {
+	return senseHatFbWidth * senseHatFbHeight * sizeof(senseHatPixel);
+}
 
 // Sense Hat Joystick
 #define SENSE_HAT_JOYSTICK_NAME ("Raspberry Pi Sense HAT Joystick")
@@ -105,12 +117,11 @@ const color cpicker_cols[] = {
 	{ .r=000, .g=000, .b=255},
 	{ .r=255, .g=000, .b=255 },
 };
-int cpicker_idx = 0;
 
 // cpicker picks a color from the cpicker colors in a circular fashion.
-color cpicker() {
-	color c = cpicker_cols[cpicker_idx];
-	cpicker_idx = (cpicker_idx + 1) % CPICKER_COLS_LEN;
+color cpicker(gameConfig *game) {
+	color c = cpicker_cols[game->cpickerIdx];
+	game->cpickerIdx = (game->cpickerIdx + 1) % CPICKER_COLS_LEN;
 	return c;
 }
 
@@ -122,10 +133,11 @@ senseHatPixel colorToPixel(const color c) {
 	int rmax = (1 << SENSE_HAT_FB_R_BITS)-1;
 	int gmax = (1 << SENSE_HAT_FB_G_BITS)-1;
 	int bmax = (1 << SENSE_HAT_FB_B_BITS)-1;
+	// color components are plain chars, which are signed off the raspberry pi
 	return (senseHatPixel){
-		.r = (c.r*rmax)/255,
-		.g = (c.g*gmax)/255,
-		.b = (c.b*bmax)/255,
+		.r = ((unsigned char) c.r*rmax)/255,
+		.g = ((unsigned char) c.g*gmax)/255,
+		.b = ((unsigned char) c.b*bmax)/255,
 	};
 }
 
@@ -212,21 +224,82 @@ bool initializeSenseHatJoystick() {
 	return ok;
 }
 
+// Virtual Framebuffer and Joystick
+// Stand-ins for the sense hat on machines without one. The framebuffer is a
+// memory-mapped file of RGB565 pixels and the joystick is a FIFO, or any
+// event device such as one created through uinput, delivering the same
+// struct input_event records as the sense hat joystick. Both plug into the
+// same senseHatFb and senseHatJoystickFd as the hardware, so rendering and
+// input take the same paths.
+char const *virtualFbPath = NULL;
+char const *virtualJoystickPath = NULL;
+
+// mapVirtualFb creates or resizes the file at path to size bytes and maps it
+// into memory. Returns NULL on failure.
+void *mapVirtualFb(char const *path, size_t const size) {
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror("unable to open virtual framebuffer");
+		return NULL;
+	}
+	if (ftruncate(fd, size) == -1) {
+		perror("unable to size virtual framebuffer");
+		close(fd);
+		return NULL;
+	}
+	void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	// the fd is not needed after mmaping
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("unable to memory-map the virtual framebuffer");
+		return NULL;
+	}
+	return map;
+}
+
+bool initializeVirtualFb() {
+	if (game.grid.x > senseHatFbHeight || game.grid.y > senseHatFbWidth) {
+		fprintf(stderr, "ERROR: virtual framebuffer smaller than the playfield\n");
+		return false;
+	}
+	senseHatFb = mapVirtualFb(virtualFbPath, senseHatFbSize());
+	return senseHatFb != NULL;
+}
+
+bool initializeVirtualJoystick() {
+	// create a FIFO unless there already is something to read from
+	if (mkfifo(virtualJoystickPath, 0644) == -1 && errno != EEXIST) {
+		perror("unable to create joystick fifo");
+		return false;
+	}
+	// also open for writing, so that the FIFO never reports end of file
+	// when the last writer goes away
+	senseHatJoystickFd = open(virtualJoystickPath, O_NONBLOCK | O_RDWR);
+	if (senseHatJoystickFd < 0) {
+		perror("unable to open virtual joystick");
+		return false;
+	}
+	return true;
+}
+
 // This function is called on the start of your application
 // Here you can initialize what ever you need for your task
 // return false if something fails, else true
 bool initializeSenseHat() {
+	// use the virtual stand-ins where configured
+	bool (*initializeFb)() = virtualFbPath ? initializeVirtualFb : initializeSenseHatFb;
+	bool (*initializeJoystick)() = virtualJoystickPath ? initializeVirtualJoystick : initializeSenseHatJoystick;
 	// initialization is only succcessful if we can get both the fb and joystick.
 	return (
-		initializeSenseHatFb() && 
-		initializeSenseHatJoystick()
+		initializeFb() && 
+		initializeJoystick()
 	);
 }
 
 // This function is called when the application exits
 // Here you can free up everything that you might have opened/allocated
 void freeSenseHat() {
-	munmap(senseHatFb, SENSE_HAT_FB_SIZE);
+	munmap(senseHatFb, senseHatFbSize());
 	close(senseHatJoystickFd);
 }
 
@@ -276,22 +349,28 @@ int readSenseHatJoystick() {
 }
 
 
+// renderPlayfield renders the playfield into a matrix of pixels with the
+// given row width.
+static inline void renderPlayfield(gameConfig *game, senseHatPixel *fb, unsigned int const width) {
+	// loop over every tile and update its corresponding pixel
+	for (unsigned int x = 0; x < game->grid.x; x++) {
+		for (unsigned int y = 0; y < game->grid.y; y++) {
+			// find the tile and convert its color to pixel. an unoccupied tile
+			// is black, so we dont need any explicit checking.
+			tile t = game->playfield[x][y];
+			fb[x * width + y] = colorToPixel(t.color);
+		}
+	}
+}
+
 // This function should render the gamefield on the LED matrix. It is called
 // every game tick. The parameter playfieldChanged signals whether the game logic
 // has changed the playfield
-void renderSenseHatMatrix(bool const playfieldChanged) {
+void renderSenseHatMatrix(gameConfig *game, bool const playfieldChanged) {
 	// exit if no changes in the playfield
 	if (!playfieldChanged) return;
 
-	// loop over every tile and update its corresponding pixel
-	for (int x = 0; x < game.grid.x; x++) {
-		for (int y = 0; y < game.grid.y; y++) {
-			// find the tile and convert its color to pixel. an unoccupied tile
-			// is black, so we dont need any explicit checking.
-			tile t = game.playfield[x][y];
-			senseHatFb[x * SENSE_HAT_FB_WIDTH + y] = colorToPixel(t.color);
-		}
-	}
+	renderPlayfield(game, senseHatFb, senseHatFbWidth);
 }
 
 
@@ -299,38 +378,38 @@ void renderSenseHatMatrix(bool const playfieldChanged) {
 // if you choose to change the playfield or the tile structure, you might need to
 // adjust this game logic <> playfield interface
 
-static inline void newTile(coord const target) {
-	tile *t = &game.playfield[target.y][target.x];
+static inline void newTile(gameConfig *game, coord const target) {
+	tile *t = &game->playfield[target.y][target.x];
 	t->occupied = true;
 	// pick a color from the cpicker!
-	t->color = cpicker();
+	t->color = cpicker(game);
 }
 
-static inline void copyTile(coord const to, coord const from) {
-	memcpy((void *) &game.playfield[to.y][to.x], (void *) &game.playfield[from.y][from.x], sizeof(tile));
+static inline void copyTile(gameConfig *game, coord const to, coord const from) {
+	memcpy((void *) &game->playfield[to.y][to.x], (void *) &game->playfield[from.y][from.x], sizeof(tile));
 }
 
-static inline void copyRow(unsigned int const to, unsigned int const from) {
-	memcpy((void *) &game.playfield[to][0], (void *) &game.playfield[from][0], sizeof(tile) * game.grid.x);
+static inline void copyRow(gameConfig *game, unsigned int const to, unsigned int const from) {
+	memcpy((void *) &game->playfield[to][0], (void *) &game->playfield[from][0], sizeof(tile) * game->grid.x);
 
 }
 
-static inline void resetTile(coord const target) {
-	memset((void *) &game.playfield[target.y][target.x], 0, sizeof(tile));
+static inline void resetTile(gameConfig *game, coord const target) {
+	memset((void *) &game->playfield[target.y][target.x], 0, sizeof(tile));
 }
 
-static inline void resetRow(unsigned int const target) {
-	memset((void *) &game.playfield[target][0], 0, sizeof(tile) * game.grid.x);
+static inline void resetRow(gameConfig *game, unsigned int const target) {
+	memset((void *) &game->playfield[target][0], 0, sizeof(tile) * game->grid.x);
 }
 
-static inline bool tileOccupied(coord const target) {
-	return game.playfield[target.y][target.x].occupied;
+static inline bool tileOccupied(gameConfig *game, coord const target) {
+	return game->playfield[target.y][target.x].occupied;
 }
 
-static inline bool rowOccupied(unsigned int const target) {
-	for (unsigned int x = 0; x < game.grid.x; x++) {
+static inline bool rowOccupied(gameConfig *game, unsigned int const target) {
+	for (unsigned int x = 0; x < game->grid.x; x++) {
 		coord const checkTile = {x, target};
-		if (!tileOccupied(checkTile)) {
+		if (!tileOccupied(game, checkTile)) {
 			return false;
 		}
 	}
@@ -338,9 +417,9 @@ static inline bool rowOccupied(unsigned int const target) {
 }
 
 
-static inline void resetPlayfield() {
-	for (unsigned int y = 0; y < game.grid.y; y++) {
-		resetRow(y);
+static inline void resetPlayfield(gameConfig *game) {
+	for (unsigned int y = 0; y < game->grid.y; y++) {
+		resetRow(game, y);
 	}
 }
 
@@ -348,110 +427,110 @@ static inline void resetPlayfield() {
 // that means no changes are necessary below this line! And if you choose to change something
 // keep it compatible with what was provided to you!
 
-bool addNewTile() {
-	game.activeTile.y = 0;
-	game.activeTile.x = (game.grid.x - 1) / 2;
-	if (tileOccupied(game.activeTile))
+bool addNewTile(gameConfig *game) {
+	game->activeTile.y = 0;
+	game->activeTile.x = (game->grid.x - 1) / 2;
+	if (tileOccupied(game, game->activeTile))
 		return false;
-	newTile(game.activeTile);
+	newTile(game, game->activeTile);
 	return true;
 }
 
-bool moveRight() {
-	coord const newTile = {game.activeTile.x + 1, game.activeTile.y};
-	if (game.activeTile.x < (game.grid.x - 1) && !tileOccupied(newTile)) {
-		copyTile(newTile, game.activeTile);
-		resetTile(game.activeTile);
-		game.activeTile = newTile;
+bool moveRight(gameConfig *game) {
+	coord const newTile = {game->activeTile.x + 1, game->activeTile.y};
+	if (game->activeTile.x < (game->grid.x - 1) && !tileOccupied(game, newTile)) {
+		copyTile(game, newTile, game->activeTile);
+		resetTile(game, game->activeTile);
+		game->activeTile = newTile;
 		return true;
 	}
 	return false;
 }
 
-bool moveLeft() {
-	coord const newTile = {game.activeTile.x - 1, game.activeTile.y};
-	if (game.activeTile.x > 0 && !tileOccupied(newTile)) {
-		copyTile(newTile, game.activeTile);
-		resetTile(game.activeTile);
-		game.activeTile = newTile;
+bool moveLeft(gameConfig *game) {
+	coord const newTile = {game->activeTile.x - 1, game->activeTile.y};
+	if (game->activeTile.x > 0 && !tileOccupied(game, newTile)) {
+		copyTile(game, newTile, game->activeTile);
+		resetTile(game, game->activeTile);
+		game->activeTile = newTile;
 		return true;
 	}
 	return false;
 }
 
 
-bool moveDown() {
-	coord const newTile = {game.activeTile.x, game.activeTile.y + 1};
-	if (game.activeTile.y < (game.grid.y - 1) && !tileOccupied(newTile)) {
-		copyTile(newTile, game.activeTile);
-		resetTile(game.activeTile);
-		game.activeTile = newTile;
+bool moveDown(gameConfig *game) {
+	coord const newTile = {game->activeTile.x, game->activeTile.y + 1};
+	if (game->activeTile.y < (game->grid.y - 1) && !tileOccupied(game, newTile)) {
+		copyTile(game, newTile, game->activeTile);
+		resetTile(game, game->activeTile);
+		game->activeTile = newTile;
 		return true;
 	}
 	return false;
 }
 
 
-bool clearRow() {
-	if (rowOccupied(game.grid.y - 1)) {
-		for (unsigned int y = game.grid.y - 1; y > 0; y--) {
-			copyRow(y, y - 1);
+bool clearRow(gameConfig *game) {
+	if (rowOccupied(game, game->grid.y - 1)) {
+		for (unsigned int y = game->grid.y - 1; y > 0; y--) {
+			copyRow(game, y, y - 1);
 		}
-		resetRow(0);
+		resetRow(game, 0);
 		return true;
 	}
 	return false;
 }
 
-void advanceLevel() {
-	game.level++;
-	switch(game.nextGameTick) {
+void advanceLevel(gameConfig *game) {
+	game->level++;
+	switch(game->nextGameTick) {
 	case 1:
 		break;
 	case 2 ... 10:
-		game.nextGameTick--;
+		game->nextGameTick--;
 		break;
 	case 11 ... 20:
-		game.nextGameTick -= 2;
+		game->nextGameTick -= 2;
 		break;
 	default:
-		game.nextGameTick -= 10;
+		game->nextGameTick -= 10;
 	}
 }
 
-void newGame() {
-	game.state = ACTIVE;
-	game.tiles = 0;
-	game.rows = 0;
-	game.score = 0;
-	game.tick = 0;
-	game.level = 0;
-	resetPlayfield();
+void newGame(gameConfig *game) {
+	game->state = ACTIVE;
+	game->tiles = 0;
+	game->rows = 0;
+	game->score = 0;
+	game->tick = 0;
+	game->level = 0;
+	resetPlayfield(game);
 }
 
-void gameOver() {
-	game.state = GAMEOVER;
-	game.nextGameTick = game.initNextGameTick;
+void gameOver(gameConfig *game) {
+	game->state = GAMEOVER;
+	game->nextGameTick = game->initNextGameTick;
 }
 
 
-bool sTetris(int const key) {
+bool sTetris(gameConfig *game, int const key) {
 	bool playfieldChanged = false;
 
-	if (game.state & ACTIVE) {
+	if (game->state & ACTIVE) {
 		// Move the current tile
 		if (key) {
 			playfieldChanged = true;
 			switch(key) {
 			case KEY_LEFT:
-				moveLeft();
+				moveLeft(game);
 				break;
 			case KEY_RIGHT:
-				moveRight();
+				moveRight(game);
 				break;
 			case KEY_DOWN:
-				while (moveDown()) {};
-				game.tick = 0;
+				while (moveDown(game)) {};
+				game->tick = 0;
 				break;
 			default:
 				playfieldChanged = false;
@@ -459,42 +538,42 @@ bool sTetris(int const key) {
 		}
 
 		// If we have reached a tick to update the game
-		if (game.tick == 0) {
+		if (game->tick == 0) {
 			// We communicate the row clear and tile add over the game state
 			// clear these bits if they were set before
-			game.state &= ~(ROW_CLEAR | TILE_ADDED);
+			game->state &= ~(ROW_CLEAR | TILE_ADDED);
 
 			playfieldChanged = true;
 			// Clear row if possible
-			if (clearRow()) {
-				game.state |= ROW_CLEAR;
-				game.rows++;
-				game.score += game.level + 1;
-				if ((game.rows % game.rowsPerLevel) == 0) {
-					advanceLevel();
+			if (clearRow(game)) {
+				game->state |= ROW_CLEAR;
+				game->rows++;
+				game->score += game->level + 1;
+				if ((game->rows % game->rowsPerLevel) == 0) {
+					advanceLevel(game);
 				}
 			}
 
 			// if there is no current tile or we cannot move it down,
 			// add a new one. If not possible, game over.
-			if (!tileOccupied(game.activeTile) || !moveDown()) {
-				if (addNewTile()) {
-					game.state |= TILE_ADDED;
-					game.tiles++;
+			if (!tileOccupied(game, game->activeTile) || !moveDown(game)) {
+				if (addNewTile(game)) {
+					game->state |= TILE_ADDED;
+					game->tiles++;
 				} else {
-					gameOver();
+					gameOver(game);
 				}
 			}
 		}
 	}
 
 	// Press any key to start a new game
-	if ((game.state == GAMEOVER) && key) {
+	if ((game->state == GAMEOVER) && key) {
 		playfieldChanged = true;
-		newGame();
-		addNewTile();
-		game.state |= TILE_ADDED;
-		game.tiles++;
+		newGame(game);
+		addNewTile(game);
+		game->state |= TILE_ADDED;
+		game->tiles++;
 	}
 
 	return playfieldChanged;
@@ -527,56 +606,1031 @@ int readKeyboard() {
 	return 0;
 }
 
-void renderConsole(bool const playfieldChanged) {
+void renderConsole(gameConfig *game, bool const playfieldChanged) {
 	if (!playfieldChanged)
 		return;
 
 	// Goto beginning of console
 	fprintf(stdout, "\033[%d;%dH", 0, 0);
-	for (unsigned int x = 0; x < game.grid.x + 2; x ++) {
+	for (unsigned int x = 0; x < game->grid.x + 2; x ++) {
 		fprintf(stdout, "-");
 	}
 	fprintf(stdout, "\n");
-	for (unsigned int y = 0; y < game.grid.y; y++) {
+	for (unsigned int y = 0; y < game->grid.y; y++) {
 		fprintf(stdout, "|");
-		for (unsigned int x = 0; x < game.grid.x; x++) {
+		for (unsigned int x = 0; x < game->grid.x; x++) {
 			coord const checkTile = {x, y};
-			fprintf(stdout, "%c", (tileOccupied(checkTile)) ? '#' : ' ');
+			fprintf(stdout, "%c", (tileOccupied(game, checkTile)) ? '#' : ' ');
 		}
 		switch (y) {
 			case 0:
-				fprintf(stdout, "| Tiles: %10u\n", game.tiles);
+				fprintf(stdout, "| Tiles: %10u\n", game->tiles);
 				break;
 			case 1:
-				fprintf(stdout, "| Rows:  %10u\n", game.rows);
+				fprintf(stdout, "| Rows:  %10u\n", game->rows);
 				break;
 			case 2:
-				fprintf(stdout, "| Score: %10u\n", game.score);
+				fprintf(stdout, "| Score: %10u\n", game->score);
 				break;
 			case 4:
-				fprintf(stdout, "| Level: %10u\n", game.level);
+				fprintf(stdout, "| Level: %10u\n", game->level);
 				break;
 			case 7:
-				fprintf(stdout, "| %17s\n", (game.state == GAMEOVER) ? "Game Over" : "");
+				fprintf(stdout, "| %17s\n", (game->state == GAMEOVER) ? "Game Over" : "");
 				break;
 		default:
 				fprintf(stdout, "|\n");
 		}
 	}
-	for (unsigned int x = 0; x < game.grid.x + 2; x++) {
+	for (unsigned int x = 0; x < game->grid.x + 2; x++) {
 		fprintf(stdout, "-");
 	}
 	fflush(stdout);
 }
 
 
-inline unsigned long uSecFromTimespec(struct timespec const ts) {
+static inline unsigned long uSecFromTimespec(struct timespec const ts) {
 	return ((ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
 }
 
+// Default tick limit.
+#define DEFAULT_TICKS 10000000
+
+// cmdArgs is a convenience struct for reading in the command line arguments.
+typedef struct {
+	bool headless;          // run the game logic without terminal or sense hat
+	unsigned long ticks;    // number of ticks to simulate in headless and bot mode
+	unsigned int seed;      // seed for the random input stream
+	char const *script;     // scripted input, one character per tick
+	char const *record;     // file to record the session into
+	char const *replay;     // recorded session to replay and verify
+	unsigned long games;    // number of games for the bot to play, 0 if off
+	unsigned int threads;   // bot search threads
+	unsigned int depth;     // bot lookahead in placements
+	unsigned int boards;    // number of games for the server to run, 0 if off
+	bool fb;                // render the server boards into a framebuffer
+	char const *vfb;        // file backing a virtual framebuffer
+	unsigned int vfbWidth;  // virtual framebuffer size in pixels
+	unsigned int vfbHeight;
+	char const *vinput;     // FIFO or event device for virtual joystick input
+} cmdArgs;
+
+// parseArgs reads the command line arguments into args.
+// Returns false if the arguments are invalid.
+bool parseArgs(int argc, char **argv, cmdArgs *args) {
+	*args = (cmdArgs){
+		.headless = false,
+		.ticks = DEFAULT_TICKS,
+		.seed = 1,
+		.script = NULL,
+		.record = NULL,
+		.replay = NULL,
+		.games = 0,
+		.threads = sysconf(_SC_NPROCESSORS_ONLN),
+		.depth = 3,
+		.boards = 0,
+		.fb = false,
+		.vfb = NULL,
+		.vfbWidth = SENSE_HAT_FB_WIDTH,
+		.vfbHeight = SENSE_HAT_FB_HEIGHT,
+		.vinput = NULL,
+	};
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--headless")) {
+			args->headless = true;
+			// the tick count is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-') {
+				args->ticks = strtoul(argv[++i], NULL, 10);
+			}
+		} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			args->seed = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--script") && i + 1 < argc) {
+			args->script = argv[++i];
+		} else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+			args->record = argv[++i];
+		} else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			args->replay = argv[++i];
+		} else if (!strcmp(argv[i], "--bot")) {
+			args->games = 100;
+			// the game count is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-') {
+				args->games = strtoul(argv[++i], NULL, 10);
+			}
+		} else if (!strcmp(argv[i], "--server") && i + 1 < argc) {
+			args->boards = strtoul(argv[++i], NULL, 10);
+			if (!args->boards) return false;
+		} else if (!strcmp(argv[i], "--fb")) {
+			args->fb = true;
+		} else if (!strcmp(argv[i], "--vfb") && i + 1 < argc) {
+			args->vfb = argv[++i];
+			// the size is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-') {
+				if (sscanf(argv[++i], "%ux%u", &args->vfbWidth, &args->vfbHeight) != 2 ||
+					!args->vfbWidth || !args->vfbHeight) {
+					return false;
+				}
+			}
+		} else if (!strcmp(argv[i], "--vinput") && i + 1 < argc) {
+			args->vinput = argv[++i];
+		} else if (!strcmp(argv[i], "--ticks") && i + 1 < argc) {
+			args->ticks = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			args->threads = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--depth") && i + 1 < argc) {
+			args->depth = strtoul(argv[++i], NULL, 10);
+		} else {
+			return false;
+		}
+	}
+	// xorshift gets stuck on a zero state
+	if (args->seed == 0) args->seed = 1;
+	return true;
+}
+
+// nextRandom advances the xorshift32 state and returns the new value.
+static inline unsigned int nextRandom(unsigned int *state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// randomKey picks a key from a random input stream. Most ticks carry no
+// input, so that tiles still fall on their own.
+static inline int randomKey(unsigned int *state) {
+	switch (nextRandom(state) % 8) {
+	case 0: return KEY_LEFT;
+	case 1: return KEY_RIGHT;
+	case 2: return KEY_DOWN;
+	}
+	return 0;
+}
+
+// scriptKey maps a script character to a key. The script of length len is
+// played in a loop: 'l' left, 'r' right, 'd' down, 'u' up, anything else is
+// no input.
+static inline int scriptKey(char const *script, size_t const len, unsigned long tick) {
+	switch (script[tick % len]) {
+	case 'l': return KEY_LEFT;
+	case 'r': return KEY_RIGHT;
+	case 'd': return KEY_DOWN;
+	case 'u': return KEY_UP;
+	}
+	return 0;
+}
+
+// headlessStats accumulates the statistics over all games of a headless run.
+typedef struct {
+	unsigned long ticks;
+	unsigned long games;
+	unsigned long tiles;
+	unsigned long rows;
+	unsigned long score;
+} headlessStats;
+
+// headlessStep advances the game logic by one tick with the given key and
+// collects the statistics of every finished game, as newGame resets them.
+// Returns whether the playfield changed.
+static inline bool headlessStep(gameConfig *game, int const key, headlessStats *stats) {
+	bool const wasActive = game->state != GAMEOVER;
+	unsigned int const prevTiles = game->tiles;
+	unsigned int const prevRows = game->rows;
+	unsigned int const prevScore = game->score;
+	bool const playfieldChanged = sTetris(game, key);
+	// a key press restarts the game within the same tick as the game over,
+	// which shows as the tile count going backwards. the tick that ends a
+	// game never clears a row, so the previous values are the final ones.
+	if (wasActive && (game->state == GAMEOVER || game->tiles < prevTiles)) {
+		stats->games++;
+		stats->tiles += prevTiles;
+		stats->rows += prevRows;
+		stats->score += prevScore;
+	}
+	game->tick = (game->tick + 1) % game->nextGameTick;
+	stats->ticks++;
+	return playfieldChanged;
+}
+
+// printHeadlessStats reports the throughput and the accumulated statistics,
+// including the game that is still running.
+void printHeadlessStats(gameConfig *game, headlessStats stats, struct timespec const sTs, struct timespec const eTs) {
+	if (game->state != GAMEOVER) {
+		stats.tiles += game->tiles;
+		stats.rows += game->rows;
+		stats.score += game->score;
+	}
+
+	unsigned long uSecElapsed = uSecFromTimespec(eTs) - uSecFromTimespec(sTs);
+	double const seconds = uSecElapsed / 1e6;
+	fprintf(stdout, "Ticks:     %lu\n", stats.ticks);
+	fprintf(stdout, "Time:      %.3f s\n", seconds);
+	fprintf(stdout, "Ticks/sec: %.0f\n", seconds > 0 ? stats.ticks / seconds : 0.0);
+	fprintf(stdout, "Games:     %lu\n", stats.games);
+	fprintf(stdout, "Tiles:     %lu\n", stats.tiles);
+	fprintf(stdout, "Rows:      %lu\n", stats.rows);
+	fprintf(stdout, "Score:     %lu\n", stats.score);
+}
+
+// playfieldHash computes a FNV-1a hash over the playfield and the game
+// counters, which identifies the outcome of a session.
+uint64_t playfieldHash(gameConfig *game) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	// mix one value into the hash, byte by byte
+	#define HASH_MIX(v) do { \
+		uint64_t mixValue = (v); \
+		for (int mixByte = 0; mixByte < 8; mixByte++) { \
+			hash ^= (mixValue >> (mixByte * 8)) & 0xff; \
+			hash *= 0x100000001b3ULL; \
+		} \
+	} while (0)
+	for (unsigned int y = 0; y < game->grid.y; y++) {
+		for (unsigned int x = 0; x < game->grid.x; x++) {
+			tile const t = game->playfield[y][x];
+			HASH_MIX(t.occupied);
+			HASH_MIX((unsigned char) t.color.r << 16 | (unsigned char) t.color.g << 8 | (unsigned char) t.color.b);
+		}
+	}
+	HASH_MIX(game->state);
+	HASH_MIX(game->tiles);
+	HASH_MIX(game->rows);
+	HASH_MIX(game->score);
+	HASH_MIX(game->level);
+	#undef HASH_MIX
+	return hash;
+}
+
+// Session recording
+// A recording is a recordHeader followed by one recordEvent per tick that
+// carried a key. Ticks count sTetris calls since the start of the session,
+// which together with the keys fully determines the game, as the color
+// picker and the game state both start from a fresh process.
+#define RECORD_MAGIC ("STR1")
+
+typedef struct {
+	char magic[4];
+	uint32_t seed;      // seed of the random input stream, 0 if interactive
+	uint64_t ticks;     // total ticks of the session
+	uint64_t hash;      // playfieldHash at the end of the session
+} __attribute__((packed)) recordHeader;
+
+typedef struct {
+	uint32_t tickDelta; // ticks since the previous event
+	uint16_t key;
+} __attribute__((packed)) recordEvent;
+
+FILE *recordFile = NULL;
+unsigned long recordLastTick = 0;
+
+// startRecording opens the recording file and reserves space for the header,
+// which is only known at the end of the session.
+bool startRecording(char const *path) {
+	recordFile = fopen(path, "wb");
+	if (!recordFile) {
+		perror("unable to open recording");
+		return false;
+	}
+	recordHeader const header = { 0 };
+	if (fwrite(&header, sizeof(header), 1, recordFile) != 1) {
+		perror("unable to write recording");
+		return false;
+	}
+	recordLastTick = 0;
+	return true;
+}
+
+// recordKey appends the key pressed at the given session tick.
+static inline void recordKey(unsigned long const tick, int const key) {
+	if (!recordFile || !key) return;
+	recordEvent const event = {
+		.tickDelta = tick - recordLastTick,
+		.key = key,
+	};
+	fwrite(&event, sizeof(event), 1, recordFile);
+	recordLastTick = tick;
+}
+
+// stopRecording writes the header and closes the recording file.
+bool stopRecording(gameConfig *game, unsigned int const seed, unsigned long const ticks) {
+	if (!recordFile) return true;
+	recordHeader header = {
+		.seed = seed,
+		.ticks = ticks,
+		.hash = playfieldHash(game),
+	};
+	memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+	bool ok = fseek(recordFile, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, recordFile) == 1;
+	if (fclose(recordFile)) ok = false;
+	recordFile = NULL;
+	if (!ok) perror("unable to write recording");
+	return ok;
+}
+
+// runHeadless drives the game logic as fast as possible from a scripted or
+// random input stream, without rendering or sleeping, and reports the
+// throughput and the accumulated game statistics.
+int runHeadless(cmdArgs const *args) {
+	unsigned int rng = args->seed;
+	headlessStats stats = { 0 };
+	struct timespec sTs, eTs;
+
+	if (args->script && !args->script[0]) {
+		fprintf(stderr, "ERROR: empty input script\n");
+		return 1;
+	}
+	if (args->record && !startRecording(args->record)) {
+		return 1;
+	}
+
+	size_t const scriptLen = args->script ? strlen(args->script) : 0;
+	clock_gettime(CLOCK_MONOTONIC, &sTs);
+	for (unsigned long i = 0; i < args->ticks; i++) {
+		int key = args->script ? scriptKey(args->script, scriptLen, i) : randomKey(&rng);
+		recordKey(i, key);
+		headlessStep(&game, key, &stats);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &eTs);
+
+	printHeadlessStats(&game, stats, sTs, eTs);
+	return stopRecording(&game, args->script ? 0 : args->seed, stats.ticks) ? 0 : 1;
+}
+
+// runReplay re-runs a recorded session as fast as possible and verifies that
+// it ends with the recorded playfield.
+int runReplay(char const *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror("unable to open recording");
+		return 1;
+	}
+	recordHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+		memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic))) {
+		fprintf(stderr, "ERROR: %s is not a stetris recording\n", path);
+		fclose(f);
+		return 1;
+	}
+
+	// read all events up front, so that the replay loop does no I/O
+	size_t eventsLen = 0, eventsCap = 1024;
+	recordEvent *events = malloc(eventsCap * sizeof(recordEvent));
+	while (events && fread(&events[eventsLen], sizeof(recordEvent), 1, f) == 1) {
+		if (++eventsLen == eventsCap) {
+			eventsCap *= 2;
+			recordEvent *grown = realloc(events, eventsCap * sizeof(recordEvent));
+			if (!grown) free(events);
+			events = grown;
+		}
+	}
+	fclose(f);
+	if (!events) {
+		fprintf(stderr, "ERROR: could not allocate recording events\n");
+		return 1;
+	}
+
+	headlessStats stats = { 0 };
+	struct timespec sTs, eTs;
+	size_t next = 0;
+	unsigned long nextTick = eventsLen ? events[0].tickDelta : 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &sTs);
+	for (unsigned long i = 0; i < header.ticks; i++) {
+		int key = 0;
+		if (next < eventsLen && i == nextTick) {
+			key = events[next++].key;
+			if (next < eventsLen) nextTick += events[next].tickDelta;
+		}
+		headlessStep(&game, key, &stats);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &eTs);
+	free(events);
+
+	printHeadlessStats(&game, stats, sTs, eTs);
+	uint64_t const hash = playfieldHash(&game);
+	fprintf(stdout, "Seed:      %u\n", header.seed);
+	fprintf(stdout, "Hash:      %016llx (recorded %016llx)\n",
+		(unsigned long long) hash, (unsigned long long) header.hash);
+	if (hash != header.hash) {
+		fprintf(stdout, "Replay:    MISMATCH\n");
+		return 1;
+	}
+	fprintf(stdout, "Replay:    OK\n");
+	return 0;
+}
+
+// Autoplayer
+// The bot picks a target column for every new tile by searching all
+// placements a few tiles ahead. Tiles are single cells that always drop to
+// the top of their column, so a board is fully described by its occupancy,
+// which fits a 64-bit snapshot for the playfield sizes we use.
+#define BOT_LOSS (-1000000)
+#define BOT_ROW_WEIGHT 100
+#define BOT_MAX_THREADS 64
+// Shallower searches take a few microseconds per decision, less than handing
+// them to the workers costs, so they run on the calling thread.
+#define BOT_PARALLEL_DEPTH 4
+// Tiles the bot plays per game. A good bot may never lose on its own, so it
+// resigns a game after this many tiles by stacking the spawn column.
+#define BOT_GAME_TILES 1000
+
+typedef uint64_t botBoard;
+
+// botTask evaluates the subtree below one first placement.
+typedef struct {
+	botBoard board;      // board after the first placement
+	int *result;         // where to store the value of the subtree
+} botTask;
+
+// botDeque holds the tasks of one worker. The owner pops from the tail, idle
+// workers steal from the head.
+typedef struct {
+	pthread_mutex_t lock;
+	botTask *tasks;
+	unsigned int head;
+	unsigned int tail;
+} botDeque;
+
+typedef struct {
+	pthread_t threads[BOT_MAX_THREADS];
+	botDeque deques[BOT_MAX_THREADS];
+	unsigned int threadsLen;  // number of workers, including the caller
+	unsigned int started;     // workers running, including the caller
+	unsigned int depth;       // placements to look ahead
+	pthread_mutex_t lock;
+	pthread_cond_t work;      // signalled when tasks are queued, or on stop
+	pthread_cond_t done;      // signalled when all tasks are finished
+	unsigned int queued;      // tasks not yet taken by any worker
+	unsigned int pending;     // tasks not yet finished
+	unsigned long nodes;      // boards evaluated
+	bool stop;
+} botPool;
+
+botPool bot;
+
+static inline botBoard botBit(unsigned int const x, unsigned int const y) {
+	return (botBoard) 1 << (y * game.grid.x + x);
+}
+
+static inline botBoard botRowMask(unsigned int const y) {
+	return (((botBoard) 1 << game.grid.x) - 1) << (y * game.grid.x);
+}
+
+// botSnapshot takes a snapshot of the playfield without the active tile.
+botBoard botSnapshot() {
+	botBoard board = 0;
+	for (unsigned int y = 0; y < game.grid.y; y++) {
+		for (unsigned int x = 0; x < game.grid.x; x++) {
+			coord const checkTile = {x, y};
+			if (tileOccupied(&game, checkTile)) board |= botBit(x, y);
+		}
+	}
+	return board & ~botBit(game.activeTile.x, game.activeTile.y);
+}
+
+// botReach returns the column a new tile ends up in when steered towards
+// target along the top row, stopping at the first occupied tile.
+static inline unsigned int botReach(botBoard const board, unsigned int const target) {
+	unsigned int x = (game.grid.x - 1) / 2;
+	while (x < target && !(board & botBit(x + 1, 0))) x++;
+	while (x > target && !(board & botBit(x - 1, 0))) x--;
+	return x;
+}
+
+// botPlace adds a new tile, steers it towards target and drops it, followed
+// by the row clear of the next game tick. Returns the number of rows cleared,
+// or -1 if the tile could not be added (game over).
+static inline int botPlace(botBoard *board, unsigned int const target) {
+	if (*board & botBit((game.grid.x - 1) / 2, 0)) return -1;
+	unsigned int const x = botReach(*board, target);
+	unsigned int y = 0;
+	while (y < game.grid.y - 1 && !(*board & botBit(x, y + 1))) y++;
+	*board |= botBit(x, y);
+
+	botBoard const bottom = botRowMask(game.grid.y - 1);
+	if ((*board & bottom) == bottom) {
+		*board = (*board & ~bottom) << game.grid.x;
+		return 1;
+	}
+	return 0;
+}
+
+// botEvaluate scores a board: low and even stacks are good, a high spawn
+// column is close to game over, full rows will be cleared later.
+int botEvaluate(botBoard const board) {
+	int score = 0, maxHeight = 0, prevHeight = -1;
+	for (unsigned int x = 0; x < game.grid.x; x++) {
+		int height = 0;
+		while (height < (int) game.grid.y && (board & botBit(x, game.grid.y - 1 - height))) height++;
+		if (height > maxHeight) maxHeight = height;
+		if (prevHeight >= 0) score -= abs(height - prevHeight);
+		if (x == (game.grid.x - 1) / 2) score -= 8 * height;
+		prevHeight = height;
+	}
+	for (unsigned int y = 0; y < game.grid.y; y++) {
+		if ((board & botRowMask(y)) == botRowMask(y)) score += BOT_ROW_WEIGHT / 2;
+	}
+	return score - 4 * maxHeight;
+}
+
+// botSearch returns the best value reachable from board with depth more
+// placements, counting the evaluated boards in nodes.
+int botSearch(botBoard const board, unsigned int const depth, unsigned long *nodes) {
+	if (depth == 0) {
+		(*nodes)++;
+		return botEvaluate(board);
+	}
+	int best = BOT_LOSS;
+	for (unsigned int x = 0; x < game.grid.x; x++) {
+		botBoard next = board;
+		int const cleared = botPlace(&next, x);
+		if (cleared < 0) continue;
+		int const value = cleared * BOT_ROW_WEIGHT + botSearch(next, depth - 1, nodes);
+		if (value > best) best = value;
+	}
+	return best;
+}
+
+// botTake takes a task from the own deque, or steals one from another worker.
+bool botTake(unsigned int const self, botTask *task) {
+	for (unsigned int i = 0; i < bot.threadsLen; i++) {
+		botDeque *d = &bot.deques[(self + i) % bot.threadsLen];
+		bool found = false;
+		pthread_mutex_lock(&d->lock);
+		if (d->head != d->tail) {
+			*task = i == 0 ? d->tasks[--d->tail] : d->tasks[d->head++];
+			found = true;
+		}
+		pthread_mutex_unlock(&d->lock);
+		if (found) {
+			__atomic_sub_fetch(&bot.queued, 1, __ATOMIC_RELAXED);
+			return true;
+		}
+	}
+	return false;
+}
+
+// botRunTasks runs tasks until there are none left to take.
+void botRunTasks(unsigned int const self) {
+	botTask task;
+	unsigned long nodes = 0;
+	while (botTake(self, &task)) {
+		*task.result = botSearch(task.board, bot.depth - 1, &nodes);
+		if (__atomic_sub_fetch(&bot.pending, 1, __ATOMIC_ACQ_REL) == 0) {
+			pthread_mutex_lock(&bot.lock);
+			pthread_cond_signal(&bot.done);
+			pthread_mutex_unlock(&bot.lock);
+		}
+	}
+	__atomic_add_fetch(&bot.nodes, nodes, __ATOMIC_RELAXED);
+}
+
+void *botWorker(void *arg) {
+	unsigned int const self = (unsigned int) (uintptr_t) arg;
+	pthread_mutex_lock(&bot.lock);
+	while (!bot.stop) {
+		if (__atomic_load_n(&bot.queued, __ATOMIC_RELAXED) == 0) {
+			pthread_cond_wait(&bot.work, &bot.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&bot.lock);
+		botRunTasks(self);
+		pthread_mutex_lock(&bot.lock);
+	}
+	pthread_mutex_unlock(&bot.lock);
+	return NULL;
+}
+
+// initializeBot starts the worker threads. The calling thread is worker 0.
+bool initializeBot(unsigned int threads, unsigned int const depth) {
+	if (game.grid.x * game.grid.y > sizeof(botBoard) * 8) {
+		fprintf(stderr, "ERROR: playfield too large for the bot\n");
+		return false;
+	}
+	if (threads < 1) threads = 1;
+	if (threads > BOT_MAX_THREADS) threads = BOT_MAX_THREADS;
+	bot.threadsLen = threads;
+	bot.depth = depth < 1 ? 1 : depth;
+	pthread_mutex_init(&bot.lock, NULL);
+	pthread_cond_init(&bot.work, NULL);
+	pthread_cond_init(&bot.done, NULL);
+	for (unsigned int i = 0; i < threads; i++) {
+		pthread_mutex_init(&bot.deques[i].lock, NULL);
+		// a worker never holds more than one decision worth of tasks
+		bot.deques[i].tasks = malloc(game.grid.x * sizeof(botTask));
+		if (!bot.deques[i].tasks) {
+			fprintf(stderr, "ERROR: could not allocate bot tasks\n");
+			return false;
+		}
+	}
+	bot.started = 1;
+	for (unsigned int i = 1; i < threads; i++) {
+		if (pthread_create(&bot.threads[i], NULL, botWorker, (void *) (uintptr_t) i)) {
+			perror("unable to start bot worker");
+			return false;
+		}
+		bot.started++;
+	}
+	return true;
+}
+
+// freeBot stops and joins the workers that were started, and frees the
+// deques. It is also called after initializeBot failed part way.
+void freeBot() {
+	if (bot.started > 1) {
+		pthread_mutex_lock(&bot.lock);
+		bot.stop = true;
+		pthread_cond_broadcast(&bot.work);
+		pthread_mutex_unlock(&bot.lock);
+	}
+	for (unsigned int i = 1; i < bot.started; i++) {
+		pthread_join(bot.threads[i], NULL);
+	}
+	for (unsigned int i = 0; i < bot.threadsLen; i++) {
+		free(bot.deques[i].tasks);
+	}
+}
+
+// botDecide searches the best target column for the active tile. With a deep
+// enough lookahead the first placements are spread over the workers, and each
+// task searches the rest of the lookahead sequentially.
+unsigned int botDecide() {
+	botBoard const board = botSnapshot();
+	unsigned int const cols = game.grid.x;
+	int firstValue[cols];
+	int results[cols];
+	bool const parallel = bot.threadsLen > 1 && bot.depth >= BOT_PARALLEL_DEPTH;
+	unsigned int tasks = 0;
+
+	for (unsigned int x = 0; x < cols; x++) {
+		botBoard next = board;
+		int const cleared = botPlace(&next, x);
+		firstValue[x] = cleared < 0 ? BOT_LOSS : cleared * BOT_ROW_WEIGHT;
+		results[x] = 0;
+		if (cleared < 0) continue;
+		if (!parallel) {
+			results[x] = botSearch(next, bot.depth - 1, &bot.nodes);
+			continue;
+		}
+		// a worker still in botRunTasks from the previous decision may take
+		// the task as soon as it is queued, and must find it counted
+		__atomic_add_fetch(&bot.pending, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&bot.queued, 1, __ATOMIC_RELAXED);
+		// queue the tasks round robin, so that every worker starts with its own
+		botDeque *d = &bot.deques[tasks++ % bot.threadsLen];
+		pthread_mutex_lock(&d->lock);
+		d->tasks[d->tail++] = (botTask){
+			.board = next,
+			.result = &results[x],
+		};
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	if (tasks) {
+		pthread_mutex_lock(&bot.lock);
+		pthread_cond_broadcast(&bot.work);
+		pthread_mutex_unlock(&bot.lock);
+
+		botRunTasks(0);
+
+		pthread_mutex_lock(&bot.lock);
+		while (__atomic_load_n(&bot.pending, __ATOMIC_ACQUIRE) != 0) {
+			pthread_cond_wait(&bot.done, &bot.lock);
+		}
+		pthread_mutex_unlock(&bot.lock);
+		// rewind the deques, under their locks as workers may still be looking
+		for (unsigned int i = 0; i < bot.threadsLen; i++) {
+			pthread_mutex_lock(&bot.deques[i].lock);
+			bot.deques[i].head = bot.deques[i].tail = 0;
+			pthread_mutex_unlock(&bot.deques[i].lock);
+		}
+	}
+	for (unsigned int x = 0; x < cols; x++) {
+		if (firstValue[x] != BOT_LOSS) firstValue[x] += results[x];
+	}
+
+	// prefer the spawn column on ties, as it needs no moves
+	unsigned int target = (cols - 1) / 2;
+	for (unsigned int x = 0; x < cols; x++) {
+		if (firstValue[x] > firstValue[target]) target = x;
+	}
+	return botReach(board, target);
+}
+
+// runBot lets the bot play the given number of games of BOT_GAME_TILES tiles
+// as fast as possible, or until the tick limit, and reports the throughput and the accumulated game
+// statistics.
+int runBot(cmdArgs const *args) {
+	headlessStats stats = { 0 };
+	struct timespec sTs, eTs;
+	unsigned long decisions = 0;
+	unsigned int botTiles = 0;   // tile count of the last decision
+	unsigned int target = 0;
+	unsigned int lastX = 0;
+	int lastKey = 0;
+
+	if (!initializeBot(args->threads, args->depth)) {
+		freeBot();
+		return 1;
+	}
+	if (args->record && !startRecording(args->record)) {
+		freeBot();
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &sTs);
+	while (stats.games < args->games && stats.ticks < args->ticks) {
+		int key = 0;
+		if (game.state == GAMEOVER) {
+			key = KEY_UP;
+		} else if (game.tiles != botTiles) {
+			// a new tile was added, drop it in place to resign the game
+			botTiles = game.tiles;
+			target = game.tiles > BOT_GAME_TILES ? game.activeTile.x : botDecide();
+			decisions++;
+			lastKey = 0;
+		}
+		if (game.state != GAMEOVER) {
+			// steer towards the target, drop if there or blocked
+			if ((lastKey == KEY_LEFT || lastKey == KEY_RIGHT) && game.activeTile.x == lastX) {
+				key = KEY_DOWN;
+			} else if (game.activeTile.x < target) {
+				key = KEY_RIGHT;
+			} else if (game.activeTile.x > target) {
+				key = KEY_LEFT;
+			} else {
+				key = KEY_DOWN;
+			}
+			lastX = game.activeTile.x;
+		}
+		lastKey = key;
+		recordKey(stats.ticks, key);
+		headlessStep(&game, key, &stats);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &eTs);
+
+	printHeadlessStats(&game, stats, sTs, eTs);
+	unsigned long uSecElapsed = uSecFromTimespec(eTs) - uSecFromTimespec(sTs);
+	double const seconds = uSecElapsed / 1e6;
+	fprintf(stdout, "Threads:   %u\n", bot.threadsLen);
+	fprintf(stdout, "Depth:     %u\n", bot.depth);
+	fprintf(stdout, "Moves:     %lu\n", decisions);
+	fprintf(stdout, "Moves/sec: %.0f\n", seconds > 0 ? decisions / seconds : 0.0);
+	fprintf(stdout, "Nodes/sec: %.0f\n", seconds > 0 ? bot.nodes / seconds : 0.0);
+	freeBot();
+	return stopRecording(&game, 0, stats.ticks) ? 0 : 1;
+}
+
+// Game server
+// Runs many independent games in one process. The instances, their row
+// pointers and their playfields each live in one contiguous allocation, in
+// board order, and every worker advances one contiguous range of boards, so
+// that a worker streams through memory and never shares a cache line of game
+// state with another worker.
+#define SERVER_CACHE_LINE 64
+#define SERVER_MAX_THREADS 64
+
+typedef struct {
+	gameConfig *games;       // all instances, contiguous
+	tile **rowPointers;      // row pointers of all playfields, contiguous
+	tile *rawPlayfields;     // all playfields, contiguous
+	unsigned int *rng;       // input stream state of every board
+	unsigned int gamesLen;
+	unsigned long ticks;     // ticks to run
+	senseHatPixel *fb;       // optional virtual framebuffer, one matrix per board
+	bool fbMapped;           // whether fb is a memory-mapped file
+	pthread_barrier_t frame; // keeps the boards in lockstep when rendering
+} gameServer;
+
+// serverWorker holds the range and the statistics of one worker, padded so
+// that workers do not share the line they update.
+typedef struct {
+	gameServer *server;
+	unsigned int beg;
+	unsigned int end;
+	headlessStats stats;
+	pthread_t thread;
+} __attribute__((aligned(SERVER_CACHE_LINE))) serverWorker;
+
+// initializeServer allocates the given number of games, using the global game
+// as the template for their settings. The framebuffer is backed by the file at
+// fbPath if given, else by memory.
+bool initializeServer(gameServer *server, unsigned int const gamesLen, unsigned int const seed,
+	bool const fb, char const *fbPath) {
+	size_t const tilesPerGame = game.grid.x * game.grid.y;
+	*server = (gameServer){ .gamesLen = gamesLen };
+	server->games = aligned_alloc(SERVER_CACHE_LINE,
+		(gamesLen * sizeof(gameConfig) + SERVER_CACHE_LINE - 1) / SERVER_CACHE_LINE * SERVER_CACHE_LINE);
+	server->rowPointers = malloc(gamesLen * game.grid.y * sizeof(tile *));
+	server->rawPlayfields = malloc(gamesLen * tilesPerGame * sizeof(tile));
+	server->rng = malloc(gamesLen * sizeof(unsigned int));
+	if (fb && fbPath) {
+		server->fb = mapVirtualFb(fbPath, gamesLen * tilesPerGame * sizeof(senseHatPixel));
+		server->fbMapped = server->fb != NULL;
+	} else if (fb) {
+		server->fb = calloc(gamesLen * tilesPerGame, sizeof(senseHatPixel));
+	}
+	if (!server->games || !server->rowPointers || !server->rawPlayfields || !server->rng || (fb && !server->fb)) {
+		fprintf(stderr, "ERROR: could not allocate %u games\n", gamesLen);
+		return false;
+	}
+
+	for (unsigned int i = 0; i < gamesLen; i++) {
+		// the settings are const, so copy the whole template
+		gameConfig *g = &server->games[i];
+		memcpy(g, &game, sizeof(gameConfig));
+		g->rawPlayfield = &server->rawPlayfields[i * tilesPerGame];
+		g->playfield = &server->rowPointers[i * game.grid.y];
+		for (unsigned int y = 0; y < game.grid.y; y++) {
+			g->playfield[y] = &g->rawPlayfield[y * game.grid.x];
+		}
+		resetPlayfield(g);
+		gameOver(g);
+		// give every board its own input stream, xorshift must not start at 0
+		server->rng[i] = seed + i * 0x9e3779b9u;
+		if (server->rng[i] == 0) server->rng[i] = 1;
+	}
+	return true;
+}
+
+void freeServer(gameServer *server) {
+	free(server->games);
+	free(server->rowPointers);
+	free(server->rawPlayfields);
+	free(server->rng);
+	if (server->fbMapped) {
+		munmap(server->fb, server->gamesLen * game.grid.x * game.grid.y * sizeof(senseHatPixel));
+	} else {
+		free(server->fb);
+	}
+}
+
+void *serverRun(void *arg) {
+	serverWorker *w = arg;
+	gameServer *server = w->server;
+	size_t const tilesPerGame = game.grid.x * game.grid.y;
+
+	for (unsigned long t = 0; t < server->ticks; t++) {
+		for (unsigned int i = w->beg; i < w->end; i++) {
+			gameConfig *g = &server->games[i];
+			bool const playfieldChanged = headlessStep(g, randomKey(&server->rng[i]), &w->stats);
+			if (server->fb && playfieldChanged) {
+				renderPlayfield(g, &server->fb[i * tilesPerGame], game.grid.y);
+			}
+		}
+		// the boards are independent, only a rendered frame needs all of them
+		if (server->fb) pthread_barrier_wait(&server->frame);
+	}
+	return NULL;
+}
+
+// runServer advances many boards per tick from random input streams, spread
+// over a pool of threads, and reports the throughput and the accumulated
+// game statistics.
+int runServer(cmdArgs const *args) {
+	gameServer server;
+	unsigned int threads = args->threads;
+	if (threads < 1) threads = 1;
+	if (threads > SERVER_MAX_THREADS) threads = SERVER_MAX_THREADS;
+	// ranges start on a cache line of the instance array, so they are whole
+	// groups of align boards, and every thread gets at least one group
+	size_t const lowBit = sizeof(gameConfig) & -sizeof(gameConfig);
+	unsigned int const align = lowBit < SERVER_CACHE_LINE ? SERVER_CACHE_LINE / lowBit : 1;
+	unsigned int const groups = (args->boards + align - 1) / align;
+	if (threads > groups) threads = groups;
+
+	if (!initializeServer(&server, args->boards, args->seed, args->fb || args->vfb, args->vfb)) {
+		freeServer(&server);
+		return 1;
+	}
+	server.ticks = args->ticks;
+	if (server.fb) pthread_barrier_init(&server.frame, NULL, threads);
+
+	// split the boards evenly into contiguous ranges of whole groups
+	serverWorker *workers = aligned_alloc(SERVER_CACHE_LINE, threads * sizeof(serverWorker));
+	if (!workers) {
+		fprintf(stderr, "ERROR: could not allocate server workers\n");
+		freeServer(&server);
+		return 1;
+	}
+	for (unsigned int i = 0; i < threads; i++) {
+		workers[i] = (serverWorker){ .server = &server };
+		workers[i].beg = (unsigned long) groups * i / threads * align;
+		workers[i].end = (unsigned long) groups * (i + 1) / threads * align;
+		if (workers[i].end > args->boards) workers[i].end = args->boards;
+	}
+
+	struct timespec sTs, eTs;
+	clock_gettime(CLOCK_MONOTONIC, &sTs);
+	unsigned int started = 1;
+	for (; started < threads; started++) {
+		if (pthread_create(&workers[started].thread, NULL, serverRun, &workers[started])) {
+			perror("unable to start server worker");
+			break;
+		}
+	}
+	if (started < threads) {
+		// the barrier would never complete, and the ranges would be lost
+		fprintf(stderr, "ERROR: could only start %u of %u threads\n", started, threads);
+		exit(1);
+	}
+	serverRun(&workers[0]);
+	for (unsigned int i = 1; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &eTs);
+
+	headlessStats stats = { 0 };
+	for (unsigned int i = 0; i < threads; i++) {
+		stats.ticks += workers[i].stats.ticks;
+		stats.games += workers[i].stats.games;
+		stats.tiles += workers[i].stats.tiles;
+		stats.rows += workers[i].stats.rows;
+		stats.score += workers[i].stats.score;
+	}
+	// include the games that are still running
+	for (unsigned int i = 0; i < args->boards; i++) {
+		if (server.games[i].state == GAMEOVER) continue;
+		stats.tiles += server.games[i].tiles;
+		stats.rows += server.games[i].rows;
+		stats.score += server.games[i].score;
+	}
+
+	unsigned long uSecElapsed = uSecFromTimespec(eTs) - uSecFromTimespec(sTs);
+	double const seconds = uSecElapsed / 1e6;
+	fprintf(stdout, "Boards:    %u\n", args->boards);
+	fprintf(stdout, "Threads:   %u\n", threads);
+	fprintf(stdout, "Ticks:     %lu\n", args->ticks);
+	fprintf(stdout, "Time:      %.3f s\n", seconds);
+	fprintf(stdout, "Ticks/sec: %.0f (board ticks)\n", seconds > 0 ? stats.ticks / seconds : 0.0);
+	fprintf(stdout, "Games:     %lu\n", stats.games);
+	fprintf(stdout, "Tiles:     %lu\n", stats.tiles);
+	fprintf(stdout, "Rows:      %lu\n", stats.rows);
+	fprintf(stdout, "Score:     %lu\n", stats.score);
+
+	if (server.fb) pthread_barrier_destroy(&server.frame);
+	free(workers);
+	freeServer(&server);
+	return 0;
+}
+
+// allocatePlayfield allocates the playing field structure.
+bool allocatePlayfield(gameConfig *game) {
+	game->rawPlayfield = (tile *) malloc(game->grid.x * game->grid.y * sizeof(tile));
+	game->playfield = (tile**) malloc(game->grid.y * sizeof(tile *));
+	if (!game->playfield || !game->rawPlayfield) {
+		return false;
+	}
+	for (unsigned int y = 0; y < game->grid.y; y++) {
+		game->playfield[y] = &(game->rawPlayfield[y * game->grid.x]);
+	}
+	return true;
+}
+
+void freePlayfield(gameConfig *game) {
+	free(game->playfield);
+	free(game->rawPlayfield);
+}
+
 int main(int argc, char **argv) {
-	(void) argc;
-	(void) argv;
+	cmdArgs args;
+	if (!parseArgs(argc, argv, &args)) {
+		fprintf(stderr, "Usage: %s [--headless [ticks]] [--seed n] [--script keys] [--record file] [--replay file]"
+			" [--bot [games]] [--server boards [--fb]]"
+			" [--vfb file [WxH]] [--vinput fifo]"
+			" [--ticks n] [--threads n] [--depth n]\n", argv[0]);
+		fprintf(stderr, "--bot resigns a game after %d tiles, and stops after its games or --ticks ticks\n",
+			BOT_GAME_TILES);
+		return 1;
+	}
+
+	// Allocate the playing field structure
+	if (!allocatePlayfield(&game)) {
+		fprintf(stderr, "ERROR: could not allocate playfield\n");
+		return 1;
+	}
+
+	// Reset playfield to make it empty
+	resetPlayfield(&game);
+	// Start with gameOver
+	gameOver(&game);
+
+	// Set up the virtual stand-ins for the sense hat
+	virtualFbPath = args.vfb;
+	virtualJoystickPath = args.vinput;
+	if (args.vfb) {
+		senseHatFbWidth = args.vfbWidth;
+		senseHatFbHeight = args.vfbHeight;
+	}
+
+	if (args.replay || args.headless || args.games || args.boards) {
+		int const ret = args.replay ? runReplay(args.replay) :
+			args.boards ? runServer(&args) :
+			args.games ? runBot(&args) : runHeadless(&args);
+		freePlayfield(&game);
+		return ret;
+	}
+
 	// This sets the stdin in a special state where each
 	// keyboard press is directly flushed to the stdin and additionally
 	// not outputted to the stdout
@@ -588,22 +1642,6 @@ int main(int argc, char **argv) {
 		tcsetattr(STDIN_FILENO, TCSANOW, &ttystate);
 	}
 
-	// Allocate the playing field structure
-	game.rawPlayfield = (tile *) malloc(game.grid.x * game.grid.y * sizeof(tile));
-	game.playfield = (tile**) malloc(game.grid.y * sizeof(tile *));
-	if (!game.playfield || !game.rawPlayfield) {
-		fprintf(stderr, "ERROR: could not allocate playfield\n");
-		return 1;
-	}
-	for (unsigned int y = 0; y < game.grid.y; y++) {
-		game.playfield[y] = &(game.rawPlayfield[y * game.grid.x]);
-	}
-
-	// Reset playfield to make it empty
-	resetPlayfield();
-	// Start with gameOver
-	gameOver();
-
 	if (!initializeSenseHat()) {
 		fprintf(stderr, "ERROR: could not initilize sense hat\n");
 		return 1;
@@ -611,9 +1649,17 @@ int main(int argc, char **argv) {
 
 	// Clear console, render first time
 	fprintf(stdout, "\033[H\033[J");
-	renderConsole(true);
-	renderSenseHatMatrix(true);
+	renderConsole(&game, true);
+	renderSenseHatMatrix(&game, true);
+
+	if (args.record && !startRecording(args.record)) {
+		freeSenseHat();
+		freePlayfield(&game);
+		return 1;
+	}
 
+	// counts the sTetris calls of the session, for recording
+	unsigned long sessionTick = 0;
 	while (true) {
 		struct timeval sTv, eTv;
 		gettimeofday(&sTv, NULL);
@@ -624,9 +1670,10 @@ int main(int argc, char **argv) {
 		if (key == KEY_ENTER)
 			break;
 
-		bool playfieldChanged = sTetris(key);
-		renderConsole(playfieldChanged);
-		renderSenseHatMatrix(playfieldChanged);
+		recordKey(sessionTick++, key);
+		bool playfieldChanged = sTetris(&game, key);
+		renderConsole(&game, playfieldChanged);
+		renderSenseHatMatrix(&game, playfieldChanged);
 
 		// Wait for next tick
 		gettimeofday(&eTv, NULL);
@@ -637,9 +1684,9 @@ int main(int argc, char **argv) {
 		game.tick = (game.tick + 1) % game.nextGameTick;
 	}
 
+	stopRecording(&game, 0, sessionTick);
 	freeSenseHat();
-	free(game.playfield);
-	free(game.rawPlayfield);
+	freePlayfield(&game);
 
 	return 0;
 }